@@ -23,69 +23,38 @@ function updateSpeed(speedMs) {
         .catch(error => console.error('Fetch error:', error));
 }
 
-// Tab switching and initialization
-document.addEventListener('DOMContentLoaded', function() {
-    document.querySelectorAll('.tab-button').forEach(button => {
-        button.addEventListener('click', () => {
-            document.querySelectorAll('.tab-button').forEach(btn => btn.classList.remove('active'));
-            document.querySelectorAll('.tab-content').forEach(content => content.classList.remove('active'));
-            button.classList.add('active');
-            document.getElementById(button.dataset.tab).classList.add('active');
-        });
+function selectTab(tabId) {
+    document.querySelectorAll('.tab-button').forEach(btn => {
+        btn.classList.toggle('active', btn.dataset.tab === tabId);
     });
+    document.querySelectorAll('.tab-content').forEach(content => {
+        content.classList.toggle('active', content.id === tabId);
+    });
+}
 
-    // Button click handling for both grids
-    const k8Grid = document.getElementById('button-grid-k8');
-    const chineseGrid = document.getElementById('button-grid-chinese');
-    
-    if (k8Grid) k8Grid.addEventListener('click', handleButtonClick);
-    if (chineseGrid) chineseGrid.addEventListener('click', handleButtonClick);
-
-    // Speed slider with debounce
-    let speedSliderTimeout = null;
-    const speedSlider = document.getElementById('speed-slider');
-    const speedValue = document.getElementById('speed-value');
-
-    if (speedSlider && speedValue) {
-        speedSlider.addEventListener('input', function() {
-            speedValue.textContent = this.value;
-
-            // Clear any existing timeout
-            if (speedSliderTimeout) {
-                clearTimeout(speedSliderTimeout);
-            }
-
-            // Set new timeout to update after slider stops
-            speedSliderTimeout = setTimeout(() => {
-                updateSpeed(this.value);
-            }, 300); // Update 300ms after last change
-        });
-    } else {
-        console.warn('Speed slider elements not found');
-    }
-});
-
-function handleButtonClick(event) {
-    if (event.target.tagName === 'BUTTON') {
-        const action = event.target.dataset.action;
-        fetch(`/action?do=${action}`)
-            .then(response => {
-                if (!response.ok) {
-                    console.error('Error sending command');
-                }
-            })
-            .catch(error => console.error('Fetch error:', error));
-    }
+function createButton(item) {
+    const button = document.createElement('button');
+    button.className = `btn ${item.style || 'gray'}`;
+    button.dataset.action = item.action;
+    button.textContent = item.label || item.action;
+    return button;
 }
 
-// Speed slider with debounce
+// Speed slider with debounce, shared by every tab that has patterns
 let speedSliderTimeout = null;
-const speedSlider = document.getElementById('speed-slider');
-const speedValue = document.getElementById('speed-value');
 
-if (speedSlider && speedValue) {
-    speedSlider.addEventListener('input', function() {
-        speedValue.textContent = this.value;
+function createSpeedControl() {
+    const control = document.createElement('div');
+    control.className = 'speed-control';
+    control.innerHTML =
+        '<label>Speed: <span class="speed-value">500</span>ms</label>' +
+        '<input type="range" class="speed-slider" min="100" max="5000" value="500" step="100">';
+
+    const slider = control.querySelector('.speed-slider');
+    slider.addEventListener('input', function() {
+        // Keep all sliders in step, the speed is global
+        document.querySelectorAll('.speed-slider').forEach(s => { s.value = this.value; });
+        document.querySelectorAll('.speed-value').forEach(v => { v.textContent = this.value; });
 
         // Clear any existing timeout
         if (speedSliderTimeout) {
@@ -97,18 +66,104 @@ if (speedSlider && speedValue) {
             updateSpeed(this.value);
         }, 300); // Update 300ms after last change
     });
-} else {
-    console.warn('Speed slider elements not found');
+    return control;
 }
 
-function updateSpeed(speedMs) {
-    fetch(`/set_speed?speed=${speedMs}`)
-        .then(response => {
+function buildTabs(remotes) {
+    const tabs = document.getElementById('tabs');
+    const contents = document.getElementById('tab-contents');
+    const activeTab = document.querySelector('.tab-button.active');
+    const activeId = activeTab ? activeTab.dataset.tab : null;
+    tabs.innerHTML = '';
+    contents.innerHTML = '';
+
+    remotes.profiles.forEach(profile => {
+        const tabId = `${profile.id}-tab`;
+
+        const tabButton = document.createElement('button');
+        tabButton.className = 'tab-button';
+        tabButton.dataset.tab = tabId;
+        tabButton.textContent = profile.name;
+        tabButton.addEventListener('click', () => selectTab(tabId));
+        tabs.appendChild(tabButton);
+
+        const content = document.createElement('div');
+        content.id = tabId;
+        content.className = 'tab-content';
+
+        const grid = document.createElement('div');
+        grid.className = 'grid';
+        profile.commands.forEach(command => grid.appendChild(createButton(command)));
+        (profile.patterns || []).forEach(pattern => grid.appendChild(createButton(pattern)));
+        grid.addEventListener('click', handleButtonClick);
+        content.appendChild(grid);
+
+        if (profile.patterns && profile.patterns.length > 0) {
+            content.appendChild(createSpeedControl());
+        }
+        contents.appendChild(content);
+    });
+
+    if (activeId && document.getElementById(activeId)) {
+        selectTab(activeId);
+    } else if (remotes.profiles.length > 0) {
+        selectTab(`${remotes.profiles[0].id}-tab`);
+    }
+}
+
+function loadRemotes() {
+    fetch('/remotes')
+        .then(response => response.json())
+        .then(buildTabs)
+        .catch(error => console.error('Failed to load remotes:', error));
+}
+
+// IR learn mode: start, then poll until the firmware reports a result
+function pollLearnStatus() {
+    const status = document.getElementById('learn-status');
+    fetch('/learn_status')
+        .then(response => response.json())
+        .then(data => {
+            if (data.state === 'waiting') {
+                status.textContent = `Press a button on the remote for "${data.action}"...`;
+                setTimeout(pollLearnStatus, 500);
+            } else if (data.state === 'learned') {
+                status.textContent = `Learned ${data.action}: ${data.protocol} 0x${data.code.toString(16).toUpperCase()}`;
+                loadRemotes();
+            } else if (data.state === 'failed') {
+                status.textContent = `Learning ${data.action} failed`;
+            }
+        })
+        .catch(error => console.error('Fetch error:', error));
+}
+
+function startLearning() {
+    const action = document.getElementById('learn-action').value.trim();
+    const label = document.getElementById('learn-label').value.trim();
+    const status = document.getElementById('learn-status');
+    fetch(`/learn?action=${encodeURIComponent(action)}&label=${encodeURIComponent(label)}`)
+        .then(response => response.text().then(text => {
             if (!response.ok) {
-                console.error('Error setting speed');
+                status.textContent = text;
             } else {
-                console.log(`Speed set to ${speedMs}ms`);
+                pollLearnStatus();
             }
+        }))
+        .catch(error => console.error('Fetch error:', error));
+}
+
+function initLearnPanel() {
+    fetch('/learn_status')
+        .then(response => response.json())
+        .then(data => {
+            if (!data.available) return;
+            document.getElementById('learn-panel').hidden = false;
+            document.getElementById('learn-button').addEventListener('click', startLearning);
         })
         .catch(error => console.error('Fetch error:', error));
 }
+
+document.addEventListener('DOMContentLoaded', function() {
+    loadRemotes();
+    initLearnPanel();
+});
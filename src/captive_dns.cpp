@@ -0,0 +1,77 @@
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include "captive_dns.h"
+#include "power.h"
+
+// Defined in main.cpp
+extern bool captivePortalActive;
+
+const uint16_t kDnsPort = 53;
+const size_t kDnsHeaderSize = 12;
+const size_t kDnsMaxPacket = 512;
+const uint16_t kDnsTypeA = 1;
+const uint32_t kDnsTtlSeconds = 60;
+
+static AsyncUDP dnsUdp;
+static uint8_t dnsAddress[4];
+
+static void answerDns(AsyncUDPPacket& packet) {
+  const uint8_t* query = packet.data();
+  size_t length = packet.length();
+  // Standard queries with exactly one question only
+  if (length <= kDnsHeaderSize || (query[2] & 0x80) || (query[2] & 0x78) ||
+      query[4] != 0 || query[5] != 1) {
+    return;
+  }
+
+  // Walk the question name to find where the question ends
+  size_t pos = kDnsHeaderSize;
+  while (pos < length && query[pos] != 0) {
+    if (query[pos] & 0xC0) return; // no compression in queries
+    pos += query[pos] + 1;
+  }
+  pos += 5; // terminating zero, type, class
+  if (pos > length) return;
+  uint16_t type = (query[pos - 4] << 8) | query[pos - 3];
+
+  uint8_t response[kDnsMaxPacket];
+  const size_t answerSize = 16;
+  if (pos + answerSize > sizeof(response)) return;
+  memcpy(response, query, pos);
+  response[2] = 0x84 | (query[2] & 0x01); // response, authoritative, keep RD
+  response[3] = 0x00;                     // no error
+  response[6] = 0;
+  response[7] = (type == kDnsTypeA) ? 1 : 0;
+  memset(response + 8, 0, 4);             // no authority / additional records
+
+  size_t size = pos;
+  if (type == kDnsTypeA) {
+    const uint8_t answer[answerSize] = {
+      0xC0, 0x0C,                          // pointer to the question name
+      0x00, 0x01, 0x00, 0x01,              // type A, class IN
+      (uint8_t)(kDnsTtlSeconds >> 24), (uint8_t)(kDnsTtlSeconds >> 16),
+      (uint8_t)(kDnsTtlSeconds >> 8), (uint8_t)kDnsTtlSeconds,
+      0x00, 0x04,
+      dnsAddress[0], dnsAddress[1], dnsAddress[2], dnsAddress[3]
+    };
+    memcpy(response + size, answer, answerSize);
+    size += answerSize;
+  }
+  packet.write(response, size);
+}
+
+static void onDnsPacket(AsyncUDPPacket& packet) {
+  uint32_t busyStart = micros();
+  if (captivePortalActive) answerDns(packet);
+  recordWakeup(micros() - busyStart);
+}
+
+bool startCaptiveDns(const IPAddress& ip) {
+  for (uint8_t i = 0; i < 4; i++) dnsAddress[i] = ip[i];
+  if (!dnsUdp.listen(kDnsPort)) {
+    Serial.println("Captive DNS failed to start");
+    return false;
+  }
+  dnsUdp.onPacket(onDnsPacket);
+  return true;
+}
@@ -0,0 +1,11 @@
+#ifndef CAPTIVE_DNS_H
+#define CAPTIVE_DNS_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Captive portal DNS: answers every A query with the AP address. Runs on
+// AsyncUDP callbacks, so unlike DNSServer it needs no polling loop.
+bool startCaptiveDns(const IPAddress& ip);
+
+#endif // CAPTIVE_DNS_H
@@ -0,0 +1,272 @@
+#include "clock_sync.h"
+#include <math.h>
+
+// ============================================================================
+// Wire Format
+// ============================================================================
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  for (uint8_t i = 0; i < 4; i++) p[i] = v >> (8 * i);
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+  for (uint8_t i = 0; i < 8; i++) p[i] = v >> (8 * i);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < 4; i++) v |= (uint32_t)p[i] << (8 * i);
+  return v;
+}
+
+static uint64_t get64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (uint8_t i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+size_t encodeSyncMessage(const SyncMessage& message, uint8_t* buffer, size_t size) {
+  if (size < kSyncMessageSize) return 0;
+  put32(buffer, kSyncMagic);
+  buffer[4] = kSyncVersion;
+  buffer[5] = static_cast<uint8_t>(message.type);
+  put16(buffer + 6, message.sequence);
+  put32(buffer + 8, message.senderId);
+  put32(buffer + 12, message.targetId);
+  put32(buffer + 16, message.periodMs);
+  put64(buffer + 20, message.t1);
+  put64(buffer + 28, message.t2);
+  put64(buffer + 36, message.t3);
+  return kSyncMessageSize;
+}
+
+bool decodeSyncMessage(const uint8_t* buffer, size_t size, SyncMessage& message) {
+  if (size < kSyncMessageSize || get32(buffer) != kSyncMagic || buffer[4] != kSyncVersion) {
+    return false;
+  }
+  uint8_t type = buffer[5];
+  if (type < static_cast<uint8_t>(SyncMessageType::Announce) ||
+      type > static_cast<uint8_t>(SyncMessageType::DelayResponse)) {
+    return false;
+  }
+  message.type = static_cast<SyncMessageType>(type);
+  message.sequence = get16(buffer + 6);
+  message.senderId = get32(buffer + 8);
+  message.targetId = get32(buffer + 12);
+  message.periodMs = get32(buffer + 16);
+  message.t1 = get64(buffer + 20);
+  message.t2 = get64(buffer + 28);
+  message.t3 = get64(buffer + 36);
+  return true;
+}
+
+// ============================================================================
+// Leader
+// ============================================================================
+
+SyncMessage makeAnnounce(uint32_t leaderId, uint16_t sequence, uint64_t nowUs, uint32_t periodMs) {
+  SyncMessage message = {};
+  message.type = SyncMessageType::Announce;
+  message.sequence = sequence;
+  message.senderId = leaderId;
+  message.periodMs = periodMs;
+  message.t3 = nowUs;
+  return message;
+}
+
+SyncMessage makeDelayResponse(const SyncMessage& request, uint32_t leaderId,
+                              uint64_t rxUs, uint64_t txUs) {
+  SyncMessage message = request;
+  message.type = SyncMessageType::DelayResponse;
+  message.senderId = leaderId;
+  message.targetId = request.senderId;
+  message.t2 = rxUs;
+  message.t3 = txUs;
+  return message;
+}
+
+// ============================================================================
+// Follower
+// ============================================================================
+
+void SyncFollower::reset() {
+  leaderId = 0;
+  periodMs = 0;
+  lastDelayUs = 0;
+  accepted = 0;
+  rejected = 0;
+  requestSequence = 0;
+  requestT1 = 0;
+  requestPending = false;
+  sampleCount = 0;
+  sampleNext = 0;
+  lastAcceptedUs = 0;
+  lastLeaderUs = 0;
+  delayCount = 0;
+  delayNext = 0;
+  fitBase = 0;
+  fitRef = 0;
+  fitOffset = 0;
+  fitDrift = 0;
+  fitRms = 0;
+}
+
+SyncMessage SyncFollower::makeDelayRequest(uint64_t nowUs) {
+  SyncMessage message = {};
+  message.type = SyncMessageType::DelayRequest;
+  message.sequence = ++requestSequence;
+  message.senderId = id;
+  message.targetId = leaderId;
+  message.t1 = nowUs;
+  requestT1 = nowUs;
+  requestPending = true;
+  return message;
+}
+
+bool SyncFollower::onAnnounce(const SyncMessage& announce, uint64_t rxUs) {
+  if (announce.type != SyncMessageType::Announce) return false;
+  if (leaderId != 0 && announce.senderId != leaderId) {
+    // Stay with the current leader while it answers, but a unit that was
+    // swapped or re-flashed (new id) takes over once the old one went quiet
+    if (rxUs - lastLeaderUs < kSyncTimeoutUs) return false;
+    reset();
+  }
+  if (leaderId == 0) {
+    leaderId = announce.senderId;
+    lastLeaderUs = rxUs;
+  }
+  periodMs = announce.periodMs;
+  if (sampleCount > 0 && fabs((double)(int64_t)(announce.t3 - rxUs) - offsetUs(rxUs)) > kSyncStepUs) {
+    // The leader's clock started again from zero, the old exchanges are useless
+    uint32_t leader = leaderId;
+    reset();
+    leaderId = leader;
+    periodMs = announce.periodMs;
+  }
+  if (sampleCount == 0) {
+    // Coarse offset (ignores the one way delay) until exchanges come in
+    fitBase = (int64_t)(announce.t3 - rxUs);
+    fitRef = rxUs;
+  }
+  return true;
+}
+
+uint32_t SyncFollower::delayThreshold() const {
+  uint32_t minDelay = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < delayCount; i++) {
+    if (delayHistory[i] < minDelay) minDelay = delayHistory[i];
+  }
+  return minDelay * 2 + kSyncDelaySlackUs;
+}
+
+bool SyncFollower::onDelayResponse(const SyncMessage& response, uint64_t rxUs) {
+  if (response.type != SyncMessageType::DelayResponse || response.targetId != id ||
+      response.senderId != leaderId || !requestPending ||
+      response.sequence != requestSequence || response.t1 != requestT1) {
+    return false;
+  }
+  requestPending = false;
+
+  int64_t roundTrip = (int64_t)(rxUs - response.t1) - (int64_t)(response.t3 - response.t2);
+  if (roundTrip < 0) {
+    rejected++;
+    return false;
+  }
+  uint32_t delay = (uint32_t)roundTrip;
+  lastDelayUs = delay;
+
+  // A long round trip was queued somewhere on the way, and the queueing is
+  // rarely the same in both directions, so its offset can't be trusted
+  bool outlier = delayCount >= kSyncDelayHistory / 2 && delay > delayThreshold();
+  delayHistory[delayNext] = delay;
+  delayNext = (delayNext + 1) % kSyncDelayHistory;
+  if (delayCount < kSyncDelayHistory) delayCount++;
+  if (outlier) {
+    rejected++;
+    return false;
+  }
+
+  int64_t offset = ((int64_t)(response.t2 - response.t1) + (int64_t)(response.t3 - rxUs)) / 2;
+  sampleLocal[sampleNext] = response.t1 + (rxUs - response.t1) / 2;
+  sampleOffset[sampleNext] = offset;
+  sampleDelay[sampleNext] = delay;
+  sampleNext = (sampleNext + 1) % kSyncWindow;
+  if (sampleCount < kSyncWindow) sampleCount++;
+  lastAcceptedUs = rxUs;
+  lastLeaderUs = rxUs;
+  accepted++;
+  fit();
+  return true;
+}
+
+void SyncFollower::fit() {
+  // Work relative to the newest exchange so the doubles stay small
+  uint8_t newest = (sampleNext + kSyncWindow - 1) % kSyncWindow;
+  fitBase = sampleOffset[newest];
+  fitRef = sampleLocal[newest];
+
+  // The offset of an exchange can be wrong by at most half the time it spent
+  // queued, so weight each one by how far its round trip is above the best
+  uint32_t minDelay = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    if (sampleDelay[i] < minDelay) minDelay = sampleDelay[i];
+  }
+  double weight[kSyncWindow];
+  double sumW = 0, meanX = 0, meanY = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    double excess = (double)(sampleDelay[i] - minDelay) / kSyncDelaySlackUs;
+    weight[i] = 1 / (1 + excess * excess);
+    sumW += weight[i];
+    meanX += weight[i] * (double)(int64_t)(sampleLocal[i] - fitRef);
+    meanY += weight[i] * (double)(sampleOffset[i] - fitBase);
+  }
+  meanX /= sumW;
+  meanY /= sumW;
+
+  double sxx = 0, sxy = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    double dx = (double)(int64_t)(sampleLocal[i] - fitRef) - meanX;
+    double dy = (double)(sampleOffset[i] - fitBase) - meanY;
+    sxx += weight[i] * dx * dx;
+    sxy += weight[i] * dx * dy;
+  }
+
+  // Drift needs a few seconds of spread to mean anything
+  fitDrift = (sampleCount >= kSyncMinSamples && sxx > kSyncMinSpanUs * kSyncMinSpanUs) ? sxy / sxx : 0;
+  if (fitDrift > kSyncMaxDriftPpm * 1e-6) fitDrift = kSyncMaxDriftPpm * 1e-6;
+  if (fitDrift < -kSyncMaxDriftPpm * 1e-6) fitDrift = -kSyncMaxDriftPpm * 1e-6;
+  fitOffset = meanY - fitDrift * meanX;
+
+  double sumSquares = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    double x = (double)(int64_t)(sampleLocal[i] - fitRef);
+    double residual = (double)(sampleOffset[i] - fitBase) - (fitOffset + fitDrift * x);
+    sumSquares += weight[i] * residual * residual;
+  }
+  fitRms = sqrt(sumSquares / sumW);
+}
+
+bool SyncFollower::synced(uint64_t nowUs) const {
+  return sampleCount >= kSyncMinSamples && nowUs - lastAcceptedUs < kSyncTimeoutUs;
+}
+
+uint64_t SyncFollower::toLeader(uint64_t localUs) const {
+  double correction = fitOffset + fitDrift * (double)(int64_t)(localUs - fitRef);
+  return localUs + fitBase + (int64_t)llround(correction);
+}
+
+uint64_t SyncFollower::toLocal(uint64_t leaderUs) const {
+  // One fixed point step is plenty for drifts in the ppm range
+  uint64_t guess = leaderUs - fitBase - (int64_t)llround(fitOffset);
+  double correction = fitOffset + fitDrift * (double)(int64_t)(guess - fitRef);
+  return leaderUs - fitBase - (int64_t)llround(correction);
+}
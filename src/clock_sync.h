@@ -0,0 +1,121 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Clock sync between several remotes so their patterns step in phase. Pure
+// C++ (no Arduino headers), times are microseconds supplied by the caller, so
+// the same code runs in the loopback simulation in tools/sync_sim.cpp.
+//
+// The leader broadcasts an Announce every second with its clock and pattern
+// step period. Followers send NTP style DelayRequests to it (t1 = follower
+// send, t2 = leader receive, t3 = leader send, t4 = follower receive). The
+// offset from each exchange is ((t2 - t1) + (t3 - t4)) / 2. Exchanges with an
+// unusually long round trip are dropped, and a least squares fit over the
+// rest, weighted towards the shortest round trips, gives offset and drift.
+
+const uint16_t kSyncPort = 4210;
+const uint32_t kSyncMagic = 0x4B385359; // "K8SY"
+const uint8_t kSyncVersion = 1;
+const size_t kSyncMessageSize = 44;
+
+const uint8_t kSyncWindow = 16;       // accepted exchanges used for the fit
+const uint8_t kSyncDelayHistory = 8;  // recent round trips for outlier rejection
+const uint8_t kSyncMinSamples = 3;    // before this the local clock is used
+const uint32_t kSyncDelaySlackUs = 1000; // queueing a round trip may add before it counts less
+const double kSyncMinSpanUs = 2000000;  // exchanges must cover this before drift is fitted
+const double kSyncMaxDriftPpm = 500;  // anything beyond is a bad fit, not a crystal
+const uint64_t kSyncTimeoutUs = 10000000;
+const double kSyncStepUs = 1000000;   // announce this far off the fit = leader restarted
+
+enum class SyncMessageType : uint8_t {
+  Announce = 1,
+  DelayRequest = 2,
+  DelayResponse = 3
+};
+
+struct SyncMessage {
+  SyncMessageType type;
+  uint16_t sequence;
+  uint32_t senderId;
+  uint32_t targetId;  // follower a DelayResponse is meant for
+  uint32_t periodMs;  // Announce: leader's pattern step period
+  uint64_t t1;        // follower send time, echoed back
+  uint64_t t2;        // leader receive time
+  uint64_t t3;        // leader send time
+};
+
+// Little endian wire format, kSyncMessageSize bytes. Encode returns 0 if the
+// buffer is too small, decode rejects anything without the magic/version.
+size_t encodeSyncMessage(const SyncMessage& message, uint8_t* buffer, size_t size);
+bool decodeSyncMessage(const uint8_t* buffer, size_t size, SyncMessage& message);
+
+SyncMessage makeAnnounce(uint32_t leaderId, uint16_t sequence, uint64_t nowUs, uint32_t periodMs);
+SyncMessage makeDelayResponse(const SyncMessage& request, uint32_t leaderId,
+                              uint64_t rxUs, uint64_t txUs);
+
+class SyncFollower {
+public:
+  explicit SyncFollower(uint32_t id = 0) : id(id) { reset(); }
+
+  void reset();
+
+  // Starts an exchange, send the result to the leader
+  SyncMessage makeDelayRequest(uint64_t nowUs);
+
+  // Returns true if the message was for us and was used. The first leader
+  // heard is followed until kSyncTimeoutUs without an accepted exchange.
+  bool onAnnounce(const SyncMessage& announce, uint64_t rxUs);
+  bool onDelayResponse(const SyncMessage& response, uint64_t rxUs);
+
+  bool hasLeader() const { return leaderId != 0; }
+  bool synced(uint64_t nowUs) const;
+
+  // Local clock <-> leader clock using the current fit
+  uint64_t toLeader(uint64_t localUs) const;
+  uint64_t toLocal(uint64_t leaderUs) const;
+
+  double offsetUs(uint64_t localUs) const { return (double)(int64_t)(toLeader(localUs) - localUs); }
+  double driftPpm() const { return fitDrift * 1e6; }
+  // RMS distance of the accepted exchanges from the fit
+  double errorUs() const { return fitRms; }
+
+  uint32_t id;
+  uint32_t leaderId;
+  uint32_t periodMs;
+  uint32_t lastDelayUs;
+  uint32_t accepted;
+  uint32_t rejected;
+
+private:
+  void fit();
+  uint32_t delayThreshold() const;
+
+  // Outstanding request
+  uint16_t requestSequence;
+  uint64_t requestT1;
+  bool requestPending;
+
+  // Accepted exchanges, offsets relative to fitBase to keep the doubles small
+  uint64_t sampleLocal[kSyncWindow];
+  int64_t sampleOffset[kSyncWindow];
+  uint32_t sampleDelay[kSyncWindow];
+  uint8_t sampleCount;
+  uint8_t sampleNext;
+  uint64_t lastAcceptedUs;
+  uint64_t lastLeaderUs;    // leader picked or last exchange with it
+
+  uint32_t delayHistory[kSyncDelayHistory];
+  uint8_t delayCount;
+  uint8_t delayNext;
+
+  // leader = local + fitBase + fitOffset + fitDrift * (local - fitRef)
+  int64_t fitBase;
+  uint64_t fitRef;
+  double fitOffset;
+  double fitDrift;
+  double fitRms;
+};
+
+#endif // CLOCK_SYNC_H
@@ -0,0 +1,336 @@
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "feedback_led.h"
+#include "power.h"
+
+// IRremote uses LEDC channel 0 / timer 0 for the 38kHz carrier, so the
+// feedback LED gets its own timer and channels
+const ledc_mode_t kLedMode = LEDC_LOW_SPEED_MODE;
+const ledc_timer_t kLedTimer = LEDC_TIMER_1;
+const ledc_channel_t kLedChannels[3] = { LEDC_CHANNEL_1, LEDC_CHANNEL_2, LEDC_CHANNEL_3 };
+const uint32_t kLedFrequency = 5000;
+const uint8_t kLedResolutionBits = 13;
+const uint16_t kLedMaxDuty = (1 << kLedResolutionBits) - 1;
+
+// Effect timings (ms)
+const uint32_t kLedLevelFadeMs = 300;   // brightness and on/off changes
+const uint32_t kLedFadeStepMs = 1500;   // Fade: each colour in, then out
+const uint32_t kLedSmoothStepMs = 1500; // Smooth: cross-fade to the next colour
+const uint32_t kLedStrobeOnMs = 40;
+const uint32_t kLedStrobeOffMs = 110;
+const uint32_t kLedFlashStepMs = 500;
+const uint32_t kLedHold = 0xFFFFFFFF;   // nothing more to do until the next command
+
+// On IDF 4.4 every duty change waits for the channel's running fade to end,
+// so long fades run as a chain of hardware fades of up to this length, and a
+// change that comes in during one is written when it ends. A new colour
+// during Fade or Smooth therefore shows up to 300ms late, in exchange for a
+// wakeup every 300ms (a 1.5s step is 5 segments).
+const uint32_t kLedFadeSegmentMs = 300;
+
+// Brightness steps mirrored from BRT Up / BRT Down (8 bit linear levels)
+const uint8_t kLedBrightness[] = { 24, 48, 96, 160, 255 };
+const uint8_t kLedBrightnessSteps = sizeof(kLedBrightness);
+
+// ============================================================================
+// Gamma Table (built at compile time)
+// ============================================================================
+
+// Gamma 2.5 (x^2 * sqrt(x)); the square root is a fixed number of Newton
+// steps so the whole table stays a C++11 constant expression
+constexpr double gammaSqrt(double x, double guess, int iterations) {
+  return iterations == 0 ? guess : gammaSqrt(x, 0.5 * (guess + x / guess), iterations - 1);
+}
+
+constexpr uint16_t gammaDuty(uint16_t level) {
+  return static_cast<uint16_t>(kLedMaxDuty * (level / 255.0) * (level / 255.0) *
+                               gammaSqrt(level / 255.0, 1.0, 20) + 0.5);
+}
+
+template <uint16_t... Levels> struct GammaTable {
+  static constexpr uint16_t duty[sizeof...(Levels)] = { gammaDuty(Levels)... };
+};
+template <uint16_t... Levels> constexpr uint16_t GammaTable<Levels...>::duty[sizeof...(Levels)];
+
+template <uint16_t N, uint16_t... Levels>
+struct MakeGammaTable : MakeGammaTable<N - 1, N - 1, Levels...> {};
+template <uint16_t... Levels> struct MakeGammaTable<0, Levels...> {
+  typedef GammaTable<Levels...> type;
+};
+
+typedef MakeGammaTable<256>::type LedGamma;
+static_assert(LedGamma::duty[0] == 0 && LedGamma::duty[255] == kLedMaxDuty,
+              "gamma table must span the full duty range");
+
+// ============================================================================
+// Effect Names
+// ============================================================================
+
+// Names used in remotes.json, indexed by LedEffect
+static const char* const kLedEffectNames[] = {
+  "none", "static", "off", "on", "fade", "smooth", "strobe", "flash", "brighter", "dimmer"
+};
+static_assert(sizeof(kLedEffectNames) / sizeof(kLedEffectNames[0]) ==
+              static_cast<uint8_t>(LedEffect::Count), "every LedEffect needs a name");
+
+bool parseLedEffect(const char* name, LedEffect& effect) {
+  if (name == nullptr) return false;
+  for (uint8_t i = 0; i < static_cast<uint8_t>(LedEffect::Count); i++) {
+    if (strcmp(name, kLedEffectNames[i]) == 0) {
+      effect = static_cast<LedEffect>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* ledEffectName(LedEffect effect) {
+  uint8_t index = static_cast<uint8_t>(effect);
+  return index < static_cast<uint8_t>(LedEffect::Count) ? kLedEffectNames[index] : "none";
+}
+
+// ============================================================================
+// Effect Model (runs in its own task)
+// ============================================================================
+
+struct LedEvent {
+  LedEffect effect;
+  uint8_t color;
+  uint32_t palette;
+};
+
+static QueueHandle_t ledQueue = NULL;
+static TaskHandle_t ledTaskHandle = NULL;
+
+// Only touched by the LED task
+static LedEffect ledEffect = LedEffect::Static;
+static uint8_t ledColor = 0;
+static uint32_t ledPalette = 0;
+static bool ledPower = true;
+static uint8_t ledBrightness = kLedBrightnessSteps - 1;
+static uint32_t ledStep = 0;
+static uint32_t ledRampMs = 0;
+
+// Fade in progress: duty at the end of the running segment, where the fade
+// ends, and how much of it is left
+static uint16_t ledDuty[3] = { 0, 0, 0 };
+static uint16_t ledTarget[3] = { 0, 0, 0 };
+static uint32_t ledFadeLeftMs = 0;
+static bool ledSegmentRunning = false;
+static uint32_t ledSegmentEndMs = 0;
+
+// Starts the next segment of the fade towards ledTarget
+static void runFadeSegment() {
+  if (ledFadeLeftMs == 0) return;
+  uint32_t segmentMs = min(ledFadeLeftMs, kLedFadeSegmentMs);
+  for (uint8_t i = 0; i < 3; i++) {
+    int32_t delta = (int32_t)ledTarget[i] - ledDuty[i];
+    uint16_t duty = ledDuty[i] + delta * (int32_t)segmentMs / (int32_t)ledFadeLeftMs;
+    if (duty != ledDuty[i]) {
+      ledc_set_fade_time_and_start(kLedMode, kLedChannels[i], duty, segmentMs, LEDC_FADE_NO_WAIT);
+      ledDuty[i] = duty;
+    }
+  }
+  ledFadeLeftMs -= segmentMs;
+  ledSegmentRunning = true;
+  ledSegmentEndMs = millis() + segmentMs;
+}
+
+// Fades to the colour over rampMs, or sets it at once when rampMs is 0. Only
+// call with no segment running, see feedbackLedTask().
+static void writeColor(uint8_t color, uint32_t rampMs) {
+  uint16_t on = ledPower ? LedGamma::duty[kLedBrightness[ledBrightness]] : 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    ledTarget[i] = (color & (1 << i)) ? on : 0;
+  }
+  ledFadeLeftMs = rampMs;
+  if (rampMs > 0) {
+    runFadeSegment();
+    return;
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    if (ledTarget[i] != ledDuty[i]) {
+      ledc_set_duty_and_update(kLedMode, kLedChannels[i], ledTarget[i], 0);
+      ledDuty[i] = ledTarget[i];
+    }
+  }
+}
+
+static const uint32_t kPaletteAll = 0x07000000 | (1 << 0) | (2 << 3) | (4 << 6) |
+                                    (3 << 9) | (6 << 12) | (5 << 15) | (7 << 18);
+static const uint32_t kPaletteRainbow = 0x06000000 | (1 << 0) | (3 << 3) | (2 << 6) |
+                                        (6 << 9) | (4 << 12) | (5 << 15);
+
+// Returns true if the LED has to change now. Brightness changes during a
+// cycling effect are picked up by its next step, running the step early
+// would skip the effect ahead.
+static bool applyEvent(const LedEvent& event) {
+  bool holding = !ledPower || ledEffect == LedEffect::Static;
+  switch (event.effect) {
+    case LedEffect::Brighter:
+      if (ledBrightness + 1 < kLedBrightnessSteps) ledBrightness++;
+      ledRampMs = kLedLevelFadeMs;
+      return holding;
+    case LedEffect::Dimmer:
+      if (ledBrightness > 0) ledBrightness--;
+      ledRampMs = kLedLevelFadeMs;
+      return holding;
+    case LedEffect::Off:
+      if (!ledPower) return false;
+      ledPower = false;
+      ledRampMs = kLedLevelFadeMs;
+      return true;
+    case LedEffect::On:
+      if (ledPower) return false;
+      ledPower = true;
+      ledRampMs = kLedLevelFadeMs;
+      ledStep = 0;
+      return true;
+    case LedEffect::None:
+      return false;
+    default:
+      break;
+  }
+
+  ledEffect = event.effect;
+  if (event.color != kLedNone) ledColor = event.color;
+  ledPalette = event.palette;
+  if (ledPaletteSize(ledPalette) == 0) {
+    if (ledEffect == LedEffect::Smooth) ledPalette = kPaletteRainbow;
+    else if (ledEffect == LedEffect::Strobe) ledPalette = ledPaletteAdd(0, ledColor ? ledColor : 7);
+    else ledPalette = kPaletteAll;
+  }
+  ledPower = true;
+  ledStep = 0;
+  ledRampMs = 0; // colour changes on the props are instant
+  return true;
+}
+
+// Runs the current step of the effect, returns ms until the next step
+static uint32_t runStep() {
+  uint32_t rampMs = ledRampMs;
+  ledRampMs = 0;
+  if (!ledPower || ledEffect == LedEffect::Static) {
+    writeColor(ledColor, rampMs);
+    return kLedHold;
+  }
+
+  uint8_t size = ledPaletteSize(ledPalette);
+  uint32_t step = ledStep++;
+  switch (ledEffect) {
+    case LedEffect::Fade:
+      if (step & 1) {
+        writeColor(0, kLedFadeStepMs);
+      } else {
+        writeColor(ledPaletteColor(ledPalette, (step / 2) % size), kLedFadeStepMs);
+      }
+      return kLedFadeStepMs;
+    case LedEffect::Smooth:
+      writeColor(ledPaletteColor(ledPalette, step % size), kLedSmoothStepMs);
+      return kLedSmoothStepMs;
+    case LedEffect::Strobe:
+      if (step & 1) {
+        writeColor(0, 0);
+        return kLedStrobeOffMs;
+      }
+      writeColor(ledPaletteColor(ledPalette, (step / 2) % size), 0);
+      return kLedStrobeOnMs;
+    case LedEffect::Flash:
+      writeColor(ledPaletteColor(ledPalette, step % size), 0);
+      return kLedFlashStepMs;
+    default:
+      return kLedHold;
+  }
+}
+
+static TickType_t ticksUntil(uint32_t dueMs, uint32_t now) {
+  int32_t left = (int32_t)(dueMs - now);
+  return left > 0 ? pdMS_TO_TICKS(left) : 0;
+}
+
+// Sleeps until the next effect step, fade segment or command. The duty ramps
+// run in the LEDC hardware, so this wakes once per step or segment, never per
+// duty change. Nothing is written while a segment runs (it would block until
+// the segment ends), a change that comes in then drops the rest of the fade
+// and runs its step when the segment is over.
+static void feedbackLedTask(void *parameter) {
+  bool stepScheduled = false;
+  uint32_t stepDueMs = 0;
+  for (;;) {
+    uint32_t now = millis();
+    // A step that is due waits for the running segment
+    TickType_t wait = portMAX_DELAY;
+    if (ledSegmentRunning) wait = ticksUntil(ledSegmentEndMs, now);
+    else if (stepScheduled) wait = ticksUntil(stepDueMs, now);
+
+    LedEvent event;
+    bool received = xQueueReceive(ledQueue, &event, wait) == pdTRUE;
+    uint32_t busyStart = micros();
+    now = millis();
+    if (received) {
+      bool changed = applyEvent(event);
+      // Apply everything already queued before touching the LED
+      while (xQueueReceive(ledQueue, &event, 0) == pdTRUE) {
+        changed |= applyEvent(event);
+      }
+      if (changed) {
+        ledFadeLeftMs = 0;
+        stepScheduled = true;
+        stepDueMs = now;
+      }
+    }
+
+    if (ledSegmentRunning && (int32_t)(now - ledSegmentEndMs) >= 0) {
+      ledSegmentRunning = false;
+    }
+    if (!ledSegmentRunning) {
+      if (stepScheduled && (int32_t)(now - stepDueMs) >= 0) {
+        uint32_t waitMs = runStep();
+        stepScheduled = waitMs != kLedHold;
+        stepDueMs = now + waitMs;
+      } else if (ledFadeLeftMs > 0) {
+        runFadeSegment();
+      }
+    }
+    recordWakeup(micros() - busyStart);
+  }
+}
+
+void initFeedbackLed(uint8_t rPin, uint8_t gPin, uint8_t bPin) {
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = kLedMode;
+  timer.duty_resolution = static_cast<ledc_timer_bit_t>(kLedResolutionBits);
+  timer.timer_num = kLedTimer;
+  timer.freq_hz = kLedFrequency;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  if (ledc_timer_config(&timer) != ESP_OK) {
+    Serial.println("Feedback LED timer setup failed");
+    return;
+  }
+
+  const uint8_t pins[3] = { rPin, gPin, bPin };
+  for (uint8_t i = 0; i < 3; i++) {
+    ledc_channel_config_t channel = {};
+    channel.gpio_num = pins[i];
+    channel.speed_mode = kLedMode;
+    channel.channel = kLedChannels[i];
+    channel.intr_type = LEDC_INTR_DISABLE;
+    channel.timer_sel = kLedTimer;
+    channel.duty = 0;
+    channel.hpoint = 0;
+    ledc_channel_config(&channel);
+  }
+  ledc_fade_func_install(0);
+
+  ledQueue = xQueueCreate(8, sizeof(LedEvent));
+  xTaskCreate(feedbackLedTask, "Feedback LED", 2048, NULL, 1, &ledTaskHandle);
+}
+
+void showLedEffect(LedEffect effect, uint8_t color, uint32_t palette) {
+  if (ledQueue == NULL || effect == LedEffect::None) return;
+  LedEvent event = { effect, color, palette };
+  xQueueSend(ledQueue, &event, 0);
+}
@@ -0,0 +1,49 @@
+#ifndef FEEDBACK_LED_H
+#define FEEDBACK_LED_H
+
+#include <Arduino.h>
+
+// Local RGB feedback LED. Driven by the LEDC peripheral with hardware fades,
+// it mirrors the effect the props are running (colour, fade, smooth, strobe,
+// flash, brightness, on/off).
+
+// Colour bits (r=1, g=2, b=4), kLedNone leaves the colour unchanged
+const uint8_t kLedRed = 0x01;
+const uint8_t kLedGreen = 0x02;
+const uint8_t kLedBlue = 0x04;
+const uint8_t kLedNone = 0xFF;
+
+enum class LedEffect : uint8_t {
+  None = 0,   // command doesn't affect the props' lighting
+  Static,     // solid colour
+  Off,
+  On,
+  Fade,       // fade each palette colour in and out
+  Smooth,     // cross-fade through the palette
+  Strobe,     // short flashes of each palette colour
+  Flash,      // jump between palette colours
+  Brighter,
+  Dimmer,
+  Count
+};
+
+// Palette: up to 8 colours, 3 bits each in the low 24 bits, count in the top byte
+const uint8_t kLedPaletteMax = 8;
+
+inline uint8_t ledPaletteSize(uint32_t palette) { return palette >> 24; }
+inline uint8_t ledPaletteColor(uint32_t palette, uint8_t i) { return (palette >> (3 * i)) & 0x07; }
+inline uint32_t ledPaletteAdd(uint32_t palette, uint8_t color) {
+  uint8_t size = ledPaletteSize(palette);
+  if (size >= kLedPaletteMax) return palette;
+  return ((palette & 0x00FFFFFF) | ((uint32_t)(color & 0x07) << (3 * size))) | ((uint32_t)(size + 1) << 24);
+}
+
+bool parseLedEffect(const char* name, LedEffect& effect);
+const char* ledEffectName(LedEffect effect);
+
+void initFeedbackLed(uint8_t rPin, uint8_t gPin, uint8_t bPin);
+
+// Queues an effect change for the LED task, safe to call from any task
+void showLedEffect(LedEffect effect, uint8_t color, uint32_t palette);
+
+#endif // FEEDBACK_LED_H
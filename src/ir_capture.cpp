@@ -0,0 +1,174 @@
+#include <Arduino.h>
+#include "ir_capture.h"
+#include "remotes.h"
+
+// Edges are timestamped in the pin interrupt and handed to loop() through a
+// single producer / single consumer ring buffer. Each entry is the duration of
+// the level that just ended, with the top bit set for marks and the next bit
+// for edges seen while our own IR LED was sending.
+const uint16_t kCaptureBufferSize = 256; // power of two
+const uint32_t kCaptureMarkBit = 0x80000000;
+const uint32_t kCaptureOwnBit = 0x40000000;
+const uint32_t kCaptureDurationMask = kCaptureOwnBit - 1;
+
+// The receiver sees our own LED, and its output lags the LED a little
+const uint32_t kIrTransmitGuardUs = 2000;
+
+static volatile uint32_t captureBuffer[kCaptureBufferSize];
+static volatile uint16_t captureHead = 0;
+static volatile uint16_t captureTail = 0;
+static volatile uint32_t lastEdgeMicros = 0;
+static volatile uint32_t captureOverflows = 0;
+static volatile bool irTransmitting = false;
+static volatile uint32_t irTransmitEndMicros = 0;
+
+static uint8_t receiverPin = 0;
+static bool captureEnabled = false;
+static TaskHandle_t captureTask = NULL;
+
+// Nothing to do until the next edge
+const unsigned long kCaptureIdleMs = 0xFFFFFFFF;
+static IrDecoder decoder;
+
+static LearnState learning = LearnState::Idle;
+static char learnActionName[kLearnNameLength];
+static char learnLabel[kLearnNameLength];
+static unsigned long learnStartedMs = 0;
+static bool frameOwn = false; // the frame being decoded has edges of our own sends
+
+static void IRAM_ATTR onIrEdge() {
+  uint32_t now = micros();
+  uint32_t duration = now - lastEdgeMicros;
+  lastEdgeMicros = now;
+  if (duration > kCaptureDurationMask) duration = kCaptureDurationMask;
+
+  // Receiver output is active low, so a high line means a mark just ended
+  uint32_t entry = duration | (digitalRead(receiverPin) ? kCaptureMarkBit : 0);
+  if (irTransmitting || now - irTransmitEndMicros < kIrTransmitGuardUs) entry |= kCaptureOwnBit;
+  uint16_t next = (captureHead + 1) & (kCaptureBufferSize - 1);
+  if (next == captureTail) {
+    captureOverflows++;
+    return;
+  }
+  captureBuffer[captureHead] = entry;
+  captureHead = next;
+
+  // Only the first edge after a quiet line wakes the task, it then sleeps
+  // until the frame gap instead of waking per edge
+  if (duration >= kIrFrameGapUs && captureTask != NULL) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(captureTask, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+}
+
+void initIrCapture(uint8_t pin, TaskHandle_t notifyTask) {
+  receiverPin = pin;
+  captureTask = notifyTask;
+  pinMode(receiverPin, INPUT_PULLUP);
+  lastEdgeMicros = micros();
+  attachInterrupt(digitalPinToInterrupt(receiverPin), onIrEdge, CHANGE);
+  captureEnabled = true;
+  Serial.printf("IR receiver enabled on pin %u\n", receiverPin);
+}
+
+bool irCaptureAvailable() {
+  return captureEnabled;
+}
+
+void setIrTransmitting(bool active) {
+  if (!active) irTransmitEndMicros = micros();
+  irTransmitting = active;
+}
+
+const IrDecoder& irDecoder() {
+  return decoder;
+}
+
+LearnState learnState() {
+  return learning;
+}
+
+const char* learnAction() {
+  return learnActionName;
+}
+
+static void onFrameDecoded() {
+  const IrDecodeResult& result = decoder.result();
+  bool own = frameOwn;
+  frameOwn = false;
+  Serial.printf("IR received: %s 0x%lX address 0x%X (%u bits)%s\n",
+                irProtocolName(result.protocol), (unsigned long)result.code,
+                result.address, result.bits, own ? ", our own send" : "");
+
+  // Never learn what we sent ourselves (patterns, web UI, follower steps)
+  if (learning != LearnState::Waiting || own) return;
+  if (addLearnedCommand(learnActionName, learnLabel, result.protocol,
+                        result.code, result.address, result.bits) &&
+      saveLearnedCommands(kLearnedPath)) {
+    learning = LearnState::Learned;
+  } else {
+    learning = LearnState::Failed;
+  }
+}
+
+unsigned long handleIrCapture() {
+  if (!captureEnabled) return kCaptureIdleMs;
+
+  while (captureTail != captureHead) {
+    uint32_t entry = captureBuffer[captureTail];
+    captureTail = (captureTail + 1) & (kCaptureBufferSize - 1);
+    if (!decoder.busy()) frameOwn = false;
+    bool done = decoder.feed(entry & kCaptureMarkBit, entry & kCaptureDurationMask);
+    if (done) onFrameDecoded();
+    if (entry & kCaptureOwnBit) frameOwn = true;
+  }
+
+  unsigned long waitMs = kCaptureIdleMs;
+
+  // No edge for a frame gap: the last frame is over
+  if (decoder.busy()) {
+    uint32_t quietUs = micros() - lastEdgeMicros;
+    if (quietUs > kIrFrameGapUs) {
+      if (decoder.flush()) {
+        onFrameDecoded();
+      }
+    } else {
+      waitMs = (kIrFrameGapUs - quietUs) / 1000 + 1;
+    }
+  }
+
+  if (learning == LearnState::Waiting) {
+    unsigned long elapsed = millis() - learnStartedMs;
+    if (elapsed > kLearnTimeoutMs) {
+      Serial.printf("Learning %s timed out\n", learnActionName);
+      learning = LearnState::Failed;
+    } else {
+      waitMs = min(waitMs, kLearnTimeoutMs - elapsed + 1);
+    }
+  }
+  return waitMs;
+}
+
+// Action names end up in URLs and JSON, keep them to [a-z0-9_]
+static bool validActionName(const char* action) {
+  size_t len = strlen(action);
+  if (len == 0 || len >= kLearnNameLength) return false;
+  for (size_t i = 0; i < len; i++) {
+    char c = action[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')) return false;
+  }
+  return true;
+}
+
+bool startLearning(const char* action, const char* label) {
+  if (!captureEnabled || !validActionName(action)) return false;
+  if (findCommand(action) >= 0 || findPattern(action) >= 0) return false;
+
+  strlcpy(learnActionName, action, sizeof(learnActionName));
+  strlcpy(learnLabel, (label && label[0]) ? label : action, sizeof(learnLabel));
+  learnStartedMs = millis();
+  learning = LearnState::Waiting;
+  Serial.printf("Learning %s, press a button on the remote\n", learnActionName);
+  return true;
+}
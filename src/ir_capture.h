@@ -0,0 +1,37 @@
+#ifndef IR_CAPTURE_H
+#define IR_CAPTURE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "ir_decoder.h"
+
+// Optional IR receiver for learning new remote codes. Wire a demodulating
+// receiver (e.g. TSOP38238, active low output) and build with
+// -D IR_RECEIVER_PIN=<gpio> to enable it.
+
+enum class LearnState : uint8_t { Idle, Waiting, Learned, Failed };
+
+const unsigned long kLearnTimeoutMs = 15000;
+const uint8_t kLearnNameLength = 32;
+
+// notifyTask is woken by the pin interrupt when a frame starts
+void initIrCapture(uint8_t pin, TaskHandle_t notifyTask);
+bool irCaptureAvailable();
+
+// Drains captured edges into the decoder, call from the notified task.
+// Returns ms until it needs to run again.
+unsigned long handleIrCapture();
+
+// Called by sendCommand() around every transmission. Frames the receiver
+// picks up from our own LED in that window are never learned.
+void setIrTransmitting(bool active);
+
+// The next decoded frame is stored as a new command named `action`
+bool startLearning(const char* action, const char* label);
+LearnState learnState();
+const char* learnAction();
+
+const IrDecoder& irDecoder();
+
+#endif // IR_CAPTURE_H
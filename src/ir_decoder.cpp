@@ -0,0 +1,229 @@
+#include "ir_decoder.h"
+
+// Nominal timings in microseconds
+const uint16_t kNecHeaderMarkUs = 9000;
+const uint16_t kNecHeaderSpaceUs = 4500;
+const uint16_t kNecRepeatSpaceUs = 2250;
+const uint16_t kSamsungHeaderMarkUs = 4500;
+const uint16_t kSamsungHeaderSpaceUs = 4500;
+const uint16_t kPulseDistanceMarkUs = 560;
+const uint16_t kPulseDistanceZeroUs = 560;
+const uint16_t kPulseDistanceOneUs = 1690;
+const uint8_t kPulseDistanceBits = 32;
+
+const uint16_t kSonyHeaderMarkUs = 2400;
+const uint16_t kSonySpaceUs = 600;
+const uint16_t kSonyZeroUs = 600;
+const uint16_t kSonyOneUs = 1200;
+const uint8_t kSonyMaxBits = 20;
+
+static bool matches(uint32_t measured, uint32_t nominal) {
+  uint32_t slack = nominal * kIrTolerancePercent / 100 + kIrToleranceSlackUs;
+  return measured + slack >= nominal && measured <= nominal + slack;
+}
+
+void IrDecoder::reset() {
+  state = State::Idle;
+  protocol = IrProtocol::NecMsb;
+  data = 0;
+  bitCount = 0;
+  hasPending = false;
+  pendingMark = false;
+  pendingDuration = 0;
+  framesDecoded = 0;
+  framesRejected = 0;
+  lastResult = IrDecodeResult{IrProtocol::NecMsb, 0, 0, 0};
+}
+
+bool IrDecoder::feed(bool mark, uint32_t durationUs) {
+  if (!hasPending) {
+    hasPending = true;
+    pendingMark = mark;
+    pendingDuration = durationUs;
+    return false;
+  }
+  // Same level as the held segment means a glitch was absorbed in between
+  if (mark == pendingMark || durationUs < kIrGlitchUs) {
+    pendingDuration += durationUs;
+    return false;
+  }
+  bool done = process(pendingMark, pendingDuration);
+  pendingMark = mark;
+  pendingDuration = durationUs;
+  return done;
+}
+
+bool IrDecoder::flush() {
+  bool done = false;
+  if (hasPending) {
+    hasPending = false;
+    done = process(pendingMark, pendingDuration);
+  }
+  if (done) return true;
+  if (state == State::SonySpace) return finishSony();
+  if (state != State::Idle) {
+    framesRejected++;
+    state = State::Idle;
+  }
+  return false;
+}
+
+uint16_t IrDecoder::feedRaw(const uint16_t* timings, uint16_t count) {
+  uint16_t frames = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    if (feed((i & 1) == 0, timings[i])) frames++;
+  }
+  if (flush()) frames++;
+  return frames;
+}
+
+bool IrDecoder::reject(bool mark, uint32_t durationUs) {
+  framesRejected++;
+  state = State::Idle;
+  // The segment that broke this frame may be the header of the next one
+  return processIdle(mark, durationUs);
+}
+
+bool IrDecoder::processIdle(bool mark, uint32_t durationUs) {
+  if (!mark) return false;
+  data = 0;
+  bitCount = 0;
+  if (matches(durationUs, kNecHeaderMarkUs)) {
+    state = State::NecHeaderSpace;
+  } else if (matches(durationUs, kSamsungHeaderMarkUs)) {
+    state = State::SamsungHeaderSpace;
+  } else if (matches(durationUs, kSonyHeaderMarkUs)) {
+    state = State::SonyHeaderSpace;
+  }
+  return false;
+}
+
+bool IrDecoder::process(bool mark, uint32_t durationUs) {
+  switch (state) {
+    case State::Idle:
+      return processIdle(mark, durationUs);
+
+    case State::NecHeaderSpace:
+      if (!mark && matches(durationUs, kNecHeaderSpaceUs)) {
+        protocol = IrProtocol::NecMsb;
+        state = State::PulseDistanceMark;
+        return false;
+      }
+      if (!mark && matches(durationUs, kNecRepeatSpaceUs)) {
+        // Repeat frame (button held), nothing new to learn
+        state = State::Idle;
+        return false;
+      }
+      return reject(mark, durationUs);
+
+    case State::SamsungHeaderSpace:
+      if (!mark && matches(durationUs, kSamsungHeaderSpaceUs)) {
+        protocol = IrProtocol::Samsung;
+        state = State::PulseDistanceMark;
+        return false;
+      }
+      return reject(mark, durationUs);
+
+    case State::SonyHeaderSpace:
+      if (!mark && matches(durationUs, kSonySpaceUs)) {
+        protocol = IrProtocol::Sony;
+        state = State::SonyMark;
+        return false;
+      }
+      return reject(mark, durationUs);
+
+    case State::PulseDistanceMark:
+      if (!mark || !matches(durationUs, kPulseDistanceMarkUs)) {
+        return reject(mark, durationUs);
+      }
+      if (bitCount == kPulseDistanceBits) {
+        return finishPulseDistance(); // stop bit
+      }
+      state = State::PulseDistanceSpace;
+      return false;
+
+    case State::PulseDistanceSpace: {
+      uint32_t bit;
+      if (!mark && matches(durationUs, kPulseDistanceZeroUs)) {
+        bit = 0;
+      } else if (!mark && matches(durationUs, kPulseDistanceOneUs)) {
+        bit = 1;
+      } else {
+        return reject(mark, durationUs);
+      }
+      // NEC_MSB keeps the frame MSB first like sendNECMSB, Samsung is LSB first
+      if (protocol == IrProtocol::NecMsb) {
+        data = (data << 1) | bit;
+      } else {
+        data |= bit << bitCount;
+      }
+      bitCount++;
+      state = State::PulseDistanceMark;
+      return false;
+    }
+
+    case State::SonyMark: {
+      uint32_t bit;
+      if (mark && matches(durationUs, kSonyZeroUs)) {
+        bit = 0;
+      } else if (mark && matches(durationUs, kSonyOneUs)) {
+        bit = 1;
+      } else {
+        return reject(mark, durationUs);
+      }
+      if (bitCount >= kSonyMaxBits) {
+        return reject(mark, durationUs);
+      }
+      data |= bit << bitCount;
+      bitCount++;
+      state = State::SonySpace;
+      return false;
+    }
+
+    case State::SonySpace:
+      if (!mark && matches(durationUs, kSonySpaceUs)) {
+        state = State::SonyMark;
+        return false;
+      }
+      if (!mark && durationUs > kSonyOneUs * 2) {
+        return finishSony(); // gap after the last bit
+      }
+      return reject(mark, durationUs);
+  }
+  return false;
+}
+
+bool IrDecoder::finishPulseDistance() {
+  state = State::Idle;
+  lastResult.protocol = protocol;
+  if (protocol == IrProtocol::NecMsb) {
+    lastResult.code = data;
+    lastResult.address = 0;
+    lastResult.bits = kPulseDistanceBits;
+  } else {
+    // Samsung: 16 bit address, then 8 bit command + inverted command
+    // (or a 16 bit command when the check byte doesn't match)
+    uint8_t command = (data >> 16) & 0xFF;
+    uint8_t check = data >> 24;
+    lastResult.address = data & 0xFFFF;
+    lastResult.code = (check == (uint8_t)~command) ? command : (data >> 16);
+    lastResult.bits = 0;
+  }
+  framesDecoded++;
+  return true;
+}
+
+bool IrDecoder::finishSony() {
+  state = State::Idle;
+  if (bitCount != 12 && bitCount != 15 && bitCount != 20) {
+    framesRejected++;
+    return false;
+  }
+  // 7 bit command, then 5, 8 or 13 address bits, all LSB first
+  lastResult.protocol = IrProtocol::Sony;
+  lastResult.code = data & 0x7F;
+  lastResult.address = data >> 7;
+  lastResult.bits = bitCount;
+  framesDecoded++;
+  return true;
+}
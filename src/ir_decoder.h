@@ -0,0 +1,87 @@
+#ifndef IR_DECODER_H
+#define IR_DECODER_H
+
+#include <stdint.h>
+#include "ir_protocol.h"
+
+// Streaming decoder for raw IR mark/space timings. Pure C++ (no Arduino
+// headers) so recorded captures can be replayed on a host. Handles NEC (as a
+// raw NEC_MSB frame, like the K8 remotes), Samsung and Sony SIRC.
+//
+// Timings are fed one at a time as they are measured; state is a handful of
+// integers, nothing is buffered or allocated per edge.
+
+// Timing tolerance: +-25% of the nominal duration plus a fixed slack for the
+// mark stretching typical of IR receiver modules
+const uint8_t kIrTolerancePercent = 25;
+const uint16_t kIrToleranceSlackUs = 50;
+
+// Pulses shorter than this are treated as noise and merged into their neighbours
+const uint16_t kIrGlitchUs = 100;
+
+// A space at least this long ends a frame
+const uint32_t kIrFrameGapUs = 8000;
+
+struct IrDecodeResult {
+  IrProtocol protocol;
+  uint32_t code;      // full frame for NEC_MSB, command otherwise
+  uint16_t address;
+  uint8_t bits;
+};
+
+class IrDecoder {
+public:
+  IrDecoder() { reset(); }
+
+  void reset();
+
+  // Feeds one mark (IR on) or space duration. Returns true when a frame was
+  // completed, the frame is then available from result().
+  bool feed(bool mark, uint32_t durationUs);
+
+  // Ends the current frame, call when the line has been idle for
+  // kIrFrameGapUs. Returns true if that completed a frame.
+  bool flush();
+
+  // Replays a raw capture: alternating mark/space durations starting with a
+  // mark (the format IRremote prints), then flushes. Returns frames decoded.
+  uint16_t feedRaw(const uint16_t* timings, uint16_t count);
+
+  bool busy() const { return state != State::Idle || hasPending; }
+  const IrDecodeResult& result() const { return lastResult; }
+
+  uint32_t framesDecoded;
+  uint32_t framesRejected;
+
+private:
+  enum class State : uint8_t {
+    Idle,
+    NecHeaderSpace,
+    SamsungHeaderSpace,
+    SonyHeaderSpace,
+    PulseDistanceMark,  // NEC / Samsung: 560us mark before every bit and the stop bit
+    PulseDistanceSpace, // NEC / Samsung: space length carries the bit
+    SonyMark,           // Sony: mark length carries the bit
+    SonySpace
+  };
+
+  bool process(bool mark, uint32_t durationUs);
+  bool processIdle(bool mark, uint32_t durationUs);
+  bool finishPulseDistance();
+  bool finishSony();
+  bool reject(bool mark, uint32_t durationUs);
+
+  State state;
+  IrProtocol protocol;
+  uint32_t data;
+  uint8_t bitCount;
+
+  // Last segment, held back one step so glitches can be merged into it
+  bool hasPending;
+  bool pendingMark;
+  uint32_t pendingDuration;
+
+  IrDecodeResult lastResult;
+};
+
+#endif // IR_DECODER_H
@@ -0,0 +1,46 @@
+#ifndef IR_PROTOCOL_H
+#define IR_PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+// IR protocols a remote profile can use. Kept free of Arduino headers so the
+// same definitions can be shared by host-side tools.
+enum class IrProtocol : uint8_t {
+  NecMsb = 0,   // raw 32 bit NEC frame, MSB first (K8 / Chinese remotes)
+  Nec,          // NEC address + command
+  Samsung,
+  Sony,
+  Rc5,
+  Rc6,
+  Jvc,
+  Lg,
+  Panasonic,
+  Count
+};
+
+const uint8_t kIrProtocolCount = static_cast<uint8_t>(IrProtocol::Count);
+
+// Names used in remotes.json, indexed by IrProtocol
+static const char* const kIrProtocolNames[kIrProtocolCount] = {
+  "NEC_MSB", "NEC", "SAMSUNG", "SONY", "RC5", "RC6", "JVC", "LG", "PANASONIC"
+};
+
+inline const char* irProtocolName(IrProtocol protocol) {
+  uint8_t index = static_cast<uint8_t>(protocol);
+  return index < kIrProtocolCount ? kIrProtocolNames[index] : "UNKNOWN";
+}
+
+// Returns false if the name is not a known protocol
+inline bool parseIrProtocol(const char* name, IrProtocol& protocol) {
+  if (name == nullptr) return false;
+  for (uint8_t i = 0; i < kIrProtocolCount; i++) {
+    if (strcmp(name, kIrProtocolNames[i]) == 0) {
+      protocol = static_cast<IrProtocol>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif // IR_PROTOCOL_H
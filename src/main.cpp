@@ -1,10 +1,14 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <LittleFS.h>
-#include <IRremote.hpp>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "tasks.h"
+#include "remotes.h"
+#include "ir_capture.h"
+#include "captive_dns.h"
+#include "power.h"
+#include "sync_udp.h"
 
 // ESPAsyncWebServer and ElegantOTA are included in tasks.h
 // AsyncTCP is required for ESPAsyncWebServer
@@ -15,29 +19,43 @@ const uint16_t rPin = 0;
 const uint16_t gPin = 1;
 const uint16_t bPin = 2;
 
+// --- Access Point ---
+const char* const kApSsid = "K8_RGB_IR_REMOTE";
+const char* const kApPassword = "SmartOne";
+
 
 unsigned long color_pair_delay = 500; // ms delay between color commands
 
 // Pattern control variables
-int currentPattern = 0; // 0=off, 1=red_blue, 2=red_green, 3=red_white, 4=green_blue, 5=green_white, 6=blue_white
-int patternState = 0; // 0=first color, 1=second color
+int currentPattern = 0; // 0=off, otherwise index into remotePatterns + 1
+int patternState = 0; // step of the pattern last sent
 unsigned long lastPatternTime = 0;
+static uint64_t patternSlot = 0; // step slot on the pattern clock, when sync is on
+static volatile bool patternRestart = false;
 
 
 // --- WiFi Event Handler ---
 void WiFiEvent(WiFiEvent_t event) {
     switch(event) {
-        case SYSTEM_EVENT_AP_START:
+        case ARDUINO_EVENT_WIFI_AP_START:
             Serial.println("AP Started");
             break;
-        case SYSTEM_EVENT_AP_STOP:
+        case ARDUINO_EVENT_WIFI_AP_STOP:
             Serial.println("AP Stopped");
             break;
-        case SYSTEM_EVENT_AP_STACONNECTED:
+        case ARDUINO_EVENT_WIFI_AP_STACONNECTED:
             Serial.println("Client Connected");
+            wakeMainTask(); // leave idle power saving
             break;
-        case SYSTEM_EVENT_AP_STADISCONNECTED:
+        case ARDUINO_EVENT_WIFI_AP_STADISCONNECTED:
             Serial.println("Client Disconnected");
+            wakeMainTask();
+            break;
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            Serial.printf("Joined sync leader, IP: %s\n", WiFi.localIP().toString().c_str());
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            Serial.println("Lost sync leader, reconnecting");
             break;
         default:
             break;
@@ -46,27 +64,18 @@ void WiFiEvent(WiFiEvent_t event) {
 
 // --- Objects ---
 // Global variables that need to be shared between files
-DNSServer dnsServer; // Still needed for captive portal
 AsyncWebServer server(80); // Changed from WebServer to AsyncWebServer for ElegantOTA
 bool otaInProgress = false;
 bool captivePortalActive = true; // We're using AP mode only for now
 
-// FreeRTOS task handle
+// FreeRTOS task handles
 TaskHandle_t elegantOTATaskHandle = NULL;
+TaskHandle_t mainTaskHandle = NULL; // Arduino loop task
+
+const unsigned long kStatusIntervalMs = 30000;
 
 // --- Forward Declarations ---
-// Color and command functions (same as before, these are defined later in this file)
-void Clear();
-void Red(); void Green(); void Blue(); void Yellow(); void Cyan(); void Magenta(); void White();
-void Off(); void Fade(); void Strobeplus(); void RGBStrobe(); void Rainbow();
-void Halfstrobe(); void BGStrobe(); void GRStrobe(); void Next(); void Demo(); void Previous();
-void ChineseRed(); void ChineseGreen(); void ChineseBlue(); void ChineseWhite();
-void ChineseBRTUp(); void ChineseBRTDown(); void ChineseOFF(); void ChineseON();
-void ChineseFLASH(); void ChineseSTROBE(); void ChineseFADE(); void ChineseSMOOTH();
-void extra_red_blue(); void extra_red_green(); void extra_red_white(); void extra_green_blue(); void extra_green_white(); void extra_blue_white();
-
-// Pattern handler (still needed)
-void handlePattern();
+unsigned long handlePattern(unsigned long now);
 
 // LittleFS helpers (defined in tasks.cpp)
 bool initLittleFS();
@@ -77,32 +86,60 @@ bool writeFile(const char* path, const String& content);
 void setup() {
     Serial.begin(115200);
     Serial.println("Starting...");
+    mainTaskHandle = xTaskGetCurrentTaskHandle();
 
-    // Setup digital pins for RGB LED
-    pinMode(rPin, OUTPUT);
-    pinMode(gPin, OUTPUT);
-    pinMode(bPin, OUTPUT);
-    Clear();
+    // Setup RGB feedback LED (LEDC PWM with hardware fades)
+    initFeedbackLed(rPin, gPin, bPin);
 
-    // Setup IR Sender
-    IrSender.begin(kIrLedPin);
+    // Initialize LittleFS (for serving our web page and the sync role)
+    if (!initLittleFS()) {
+        Serial.println("Failed to initialize LittleFS, but continuing...");
+    }
+    SyncRole syncRole = loadSyncRole();
 
     // Improved WiFi AP Setup
     WiFi.onEvent(WiFiEvent);
-    WiFi.mode(WIFI_AP);
-    WiFi.softAP("K8_RGB_IR_REMOTE", "SmartOne", 1, 0, 4);
+    if (syncRole == SyncRole::Follower) {
+        // Join the leader as a station and keep an AP of our own for the
+        // operator, on another subnet so the two don't clash
+        char ssid[32];
+        snprintf(ssid, sizeof(ssid), "%s_%04X", kApSsid, (uint16_t)(ESP.getEfuseMac() >> 32));
+        WiFi.mode(WIFI_AP_STA);
+        WiFi.softAPConfig(IPAddress(192, 168, 5, 1), IPAddress(192, 168, 5, 1), IPAddress(255, 255, 255, 0));
+        WiFi.softAP(ssid, kApPassword, 1, 0, 4);
+        WiFi.setSleep(false); // modem sleep would hold sync packets back for a beacon interval
+        WiFi.setAutoReconnect(true);
+        WiFi.begin(kSyncLeaderSsid, kSyncLeaderPassword);
+    } else if (syncRole == SyncRole::Leader) {
+        WiFi.mode(WIFI_AP);
+        WiFi.softAP(kSyncLeaderSsid, kSyncLeaderPassword, 1, 0, 4);
+    } else {
+        WiFi.mode(WIFI_AP);
+        WiFi.softAP(kApSsid, kApPassword, 1, 0, 4);
+    }
     WiFi.setTxPower(WIFI_POWER_8_5dBm);    
     Serial.print("AP IP address: ");
     Serial.println(WiFi.softAPIP());
 
     // Setup DNS Server for Captive Portal
-    dnsServer.start(53, "*", WiFi.softAPIP());
+    startCaptiveDns(WiFi.softAPIP());
 
-    // Initialize LittleFS (for serving our web page)
-    if (!initLittleFS()) {
-        Serial.println("Failed to initialize LittleFS, but continuing...");
+    // Leader / follower clock sync for running patterns in phase
+    startClockSync(syncRole);
+
+    // Setup IR Sender and load remote profiles from LittleFS
+    if (!initRemotes(kIrLedPin, kRemotesPath)) {
+        Serial.println("No remote commands loaded, upload the filesystem");
     }
 
+#ifdef IR_RECEIVER_PIN
+    // Optional IR receiver for learning new codes
+    initIrCapture(IR_RECEIVER_PIN, mainTaskHandle);
+#endif
+
+    // Light sleep / CPU frequency scaling while idle
+    initPowerManagement();
+
     // Create ElegantOTA task (handles web server and OTA updates)
     xTaskCreatePinnedToCore(
         elegantOTATask,      // Task function
@@ -119,290 +156,99 @@ void setup() {
 
 unsigned long lastStatusCheck = 0;
 void loop() {
-    // The web server and DNS are handled by the ElegantOTA task
-    // We just need to handle our pattern logic and status updates
+    // The web server and DNS are event driven (AsyncTCP / AsyncUDP). This
+    // task only wakes for pattern steps, IR frames, the status print, or when
+    // another task notifies it, and sleeps until the nearest deadline.
+    uint32_t busyStart = micros();
+    unsigned long now = millis();
 
-    handlePattern();
+    unsigned long waitMs = handlePattern(now);
+    waitMs = min(waitMs, handleIrCapture());
 
     // Print status every 30 seconds
-    if (millis() - lastStatusCheck > 30000) {
-        lastStatusCheck = millis();
-        Serial.printf("AP Status - IP: %s, Clients: %d\n", 
+    if (now - lastStatusCheck >= kStatusIntervalMs) {
+        lastStatusCheck = now;
+        const PowerStats& power = updatePowerStats();
+        Serial.printf("AP Status - IP: %s, Clients: %d, Wakeups/s: %.1f, CPU: %luMHz, Est. current: %.0fmA\n",
                      WiFi.softAPIP().toString().c_str(), 
-                     WiFi.softAPgetStationNum());
+                     WiFi.softAPgetStationNum(),
+                     power.wakeupsPerSecond, (unsigned long)power.cpuMhz,
+                     power.estimatedCurrentMa);
+        SyncStatus sync = syncStatus();
+        if (sync.role == SyncRole::Follower) {
+            Serial.printf("Sync Status - %s, Offset: %+.0fus, Drift: %+.1fppm, Error: %.0fus, Delay: %luus, Accepted/Rejected: %lu/%lu\n",
+                         sync.synced ? "synced" : "not synced", sync.offsetUs, sync.driftPpm, sync.errorUs,
+                         (unsigned long)sync.delayUs, (unsigned long)sync.accepted, (unsigned long)sync.rejected);
+        }
     }
+    waitMs = min(waitMs, kStatusIntervalMs - (now - lastStatusCheck));
 
-    delay(10);  // Small delay to prevent watchdog issues
-}
-
-
-void handlePattern() {
-    if (currentPattern == 0) return;
+    setIdlePower(currentPattern == 0 && WiFi.softAPgetStationNum() == 0);
+    recordWakeup(micros() - busyStart);
 
-    unsigned long now = millis();
-    if (now - lastPatternTime >= color_pair_delay) {
-        lastPatternTime = now;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+}
 
-        switch (currentPattern) {
-            case 1: // red_blue
-                if (patternState == 0) {
-                    ChineseRed();
-                    patternState = 1;
-                } else {
-                    ChineseBlue();
-                    patternState = 0;
-                }
-                break;
-            case 2: // red_green
-                if (patternState == 0) {
-                    ChineseRed();
-                    patternState = 1;
-                } else {
-                    ChineseGreen();
-                    patternState = 0;
-                }
-                break;
-            case 3: // red_white
-                if (patternState == 0) {
-                    ChineseRed();
-                    patternState = 1;
-                } else {
-                    ChineseWhite();
-                    patternState = 0;
-                }
-                break;
-            case 4: // green_blue
-                if (patternState == 0) {
-                    ChineseGreen();
-                    patternState = 1;
-                } else {
-                    ChineseBlue();
-                    patternState = 0;
-                }
-                break;
-            case 5: // green_white
-                if (patternState == 0) {
-                    ChineseGreen();
-                    patternState = 1;
-                } else {
-                    ChineseWhite();
-                    patternState = 0;
-                }
-                break;
-            case 6: // blue_white
-                if (patternState == 0) {
-                    ChineseBlue();
-                    patternState = 1;
-                } else {
-                    ChineseWhite();
-                    patternState = 0;
-                }
-                break;
-            default:
-                currentPattern = 0;
-                patternState = 0;
-                break;
-        }
+void wakeMainTask() {
+    if (mainTaskHandle != NULL) {
+        xTaskNotifyGive(mainTaskHandle);
     }
 }
 
-// --- Color and Command Functions ---
-void Clear() { 
-    // Serial.println("Clear called");
-    digitalWrite(rPin, LOW);
-    digitalWrite(gPin, LOW);
-    digitalWrite(bPin, LOW);
-}
-void Red() { 
-    Serial.println("Red called");
-    Clear(); 
-    digitalWrite(rPin, HIGH);
-    IrSender.sendNECMSB(0xFF10EF, 32, false);
-}
-void Green() { 
-    Serial.println("Green called");
-    Clear(); 
-    digitalWrite(gPin, HIGH);
-    IrSender.sendNECMSB(0xFF906F, 32, false);
-}
-void Blue() { 
-    Serial.println("Blue called");
-    Clear(); 
-    digitalWrite(bPin, HIGH);
-    IrSender.sendNECMSB(0xFF50AF, 32, false);
-}
-void Yellow() { 
-    Serial.println("Yellow called");
-    Clear(); 
-    digitalWrite(rPin, HIGH);
-    digitalWrite(gPin, HIGH);
-    IrSender.sendNECMSB(0xFFD02F, 32, false);
-}
-void Cyan() { 
-    Serial.println("Cyan called");
-    Clear(); 
-    digitalWrite(gPin, HIGH);
-    digitalWrite(bPin, HIGH);
-    IrSender.sendNECMSB(0xFFB04F, 32, false);
-}
-void Magenta() { 
-    Serial.println("Magenta called");
-    Clear(); 
-    digitalWrite(rPin, HIGH);
-    digitalWrite(bPin, HIGH);
-    IrSender.sendNECMSB(0xFF30CF, 32, false);
-}
-void White() { 
-    Serial.println("White called");
-    digitalWrite(rPin, HIGH);
-    digitalWrite(gPin, HIGH);
-    digitalWrite(bPin, HIGH);
-    IrSender.sendNECMSB(0xFF708F, 32, false);
-}
-void Off() { 
-    Serial.println("Off called");
-    Clear(); 
-    IrSender.sendNECMSB(0xFFE01F, 32, false);
-}
-void Fade() { 
-    Serial.println("Fade called");
-    IrSender.sendNECMSB(0xFFF00F, 32, false);
-}
-void Strobeplus() { 
-    Serial.println("Strobeplus called");
-    IrSender.sendNECMSB(0xFFA857, 32, false);
-}
-void RGBStrobe() { 
-    Serial.println("RGBStrobe called");
-    IrSender.sendNECMSB(0xFF28D7, 32, false);
-}
-void Rainbow() { 
-    Serial.println("Rainbow called");
-    IrSender.sendNECMSB(0xFF6897, 32, false);
-}
-void Halfstrobe() { 
-    Serial.println("Halfstrobe called");
-    IrSender.sendNECMSB(0xFFE817, 32, false);
-}
-void BGStrobe() { 
-    Serial.println("BGStrobe called");
-    IrSender.sendNECMSB(0xFF9867, 32, false);
-}
-void GRStrobe() { 
-    Serial.println("GRStrobe called");
-    IrSender.sendNECMSB(0xFF18E7, 32, false);
-}
-void Next() { 
-    Serial.println("Next called");
-    IrSender.sendNECMSB(0xFF20DF, 32, false);
-}
-void Demo() { 
-    Serial.println("Demo called");
-    IrSender.sendNECMSB(0xFF58A7, 32, false);
-}
-void Previous() { 
-    Serial.println("Previous called");
-    IrSender.sendNECMSB(0xFFA05F, 32, false);
+void startPattern(uint8_t index) {
+    if (index >= remotePatternCount) return;
+    Serial.printf("Pattern %s started\n", patternAction(index));
+    patternRestart = true; // send the current step at once
+    currentPattern = index + 1;
+    wakeMainTask();
 }
 
-void ChineseRed() { 
-    Serial.println("ChineseRed called");
-    Clear(); 
-    digitalWrite(rPin, HIGH);
-    IrSender.sendNECMSB(0x00F720DF, 32, false);
-}
-void ChineseGreen() { 
-    Serial.println("ChineseGreen called");
-    Clear(); 
-    digitalWrite(gPin, HIGH);
-    IrSender.sendNECMSB(0x00F7A05F, 32, false);
-}
-void ChineseBlue() { 
-    Serial.println("ChineseBlue called");
-    Clear(); 
-    digitalWrite(bPin, HIGH);
-    IrSender.sendNECMSB(0x00F7609F, 32, false);
-}
-void ChineseWhite() { 
-    Serial.println("ChineseWhite called");
-    Clear(); 
-    digitalWrite(rPin, HIGH);
-    digitalWrite(gPin, HIGH);
-    digitalWrite(bPin, HIGH);
-    IrSender.sendNECMSB(0x00F7E01F, 32, false);
-}
-void ChineseBRTUp() { 
-    Serial.println("ChineseBRTUp called");
-    IrSender.sendNECMSB(0x00F700FF, 32, false);
-}
-void ChineseBRTDown() { 
-    Serial.println("ChineseBRTDown called");
-    IrSender.sendNECMSB(0x00F7807F, 32, false);
-}
-void ChineseOFF() { 
-    Serial.println("ChineseOFF called");
-    IrSender.sendNECMSB(0x00F740BF, 32, false);
-}
-void ChineseON() { 
-    Serial.println("ChineseON called");
-    IrSender.sendNECMSB(0x00F7C03F, 32, false);
-}
-void ChineseFLASH() { 
-    Serial.println("ChineseFLASH called");
-    IrSender.sendNECMSB(0x00F7D02F, 32, false);
-}
-void ChineseSTROBE() { 
-    Serial.println("ChineseSTROBE called");
-    IrSender.sendNECMSB(0x00F7F00F, 32, false);
-}
-void ChineseFADE() { 
-    Serial.println("ChineseFADE called");
-    IrSender.sendNECMSB(0x00F7C837, 32, false);
-}
-void ChineseSMOOTH() { 
-    Serial.println("ChineseSMOOTH called");
-    IrSender.sendNECMSB(0x00F7E817, 32, false);
-}
+// Standalone: the pattern starts at step 0 and steps every color_pair_delay
+// from there. Returns ms until the next step.
+static unsigned long handleLocalPattern(unsigned long now, const RemotePattern& pattern) {
+    unsigned long delayMs = color_pair_delay; // may change from the web task
+    bool restart = patternRestart;
+    if (restart || now - lastPatternTime >= delayMs) {
+        patternRestart = false;
+        patternState = restart ? 0 : (patternState + 1) % pattern.stepCount;
+        lastPatternTime = now;
+        sendCommand(pattern.steps[patternState]);
+    }
+    unsigned long elapsed = millis() - lastPatternTime; // sending blocks for the length of the frame
+    return elapsed >= delayMs ? 0 : delayMs - elapsed;
+}
+
+// With clock sync on, patterns step on a grid of color_pair_delay slots of
+// the pattern clock, which is the leader's clock on a synced follower, so
+// every unit sends the same step at the same moment. Otherwise they run from
+// when they were started. Returns ms until the next step.
+unsigned long handlePattern(unsigned long now) {
+    if (currentPattern == 0) return kStatusIntervalMs;
+    if (currentPattern > remotePatternCount) {
+        currentPattern = 0;
+        patternState = 0;
+        return kStatusIntervalMs;
+    }
+    const RemotePattern& pattern = remotePatterns[currentPattern - 1];
+    if (clockSyncRole() == SyncRole::Off) {
+        return handleLocalPattern(now, pattern);
+    }
 
-void extra_red_blue() {
-    Serial.println("extra_red_blue called");
-    currentPattern = 1;
-    patternState = 0;
-    lastPatternTime = millis();
-    ChineseRed();
-}
-void extra_red_green() {
-    Serial.println("extra_red_green called");
-    currentPattern = 2;
-    patternState = 0;
-    lastPatternTime = millis();
-    ChineseRed();
-}
-void extra_red_white() {
-    Serial.println("extra_red_white called");
-    currentPattern = 3;
-    patternState = 0;
-    lastPatternTime = millis();
-    ChineseRed();
-}
-void extra_green_blue() {
-    Serial.println("extra_green_blue called");
-    currentPattern = 4;
-    patternState = 0;
-    lastPatternTime = millis();
-    ChineseGreen();
-}
-void extra_green_white() {
-    Serial.println("extra_green_white called");
-    currentPattern = 5;
-    patternState = 0;
-    lastPatternTime = millis();
-    ChineseGreen();
-}
-void extra_blue_white() {
-    Serial.println("extra_blue_white called");
-    currentPattern = 6;
-    patternState = 0;
-    lastPatternTime = millis();
-    ChineseBlue();
+    uint64_t periodUs = (uint64_t)color_pair_delay * 1000; // may change from the web task
+    uint64_t clockUs = syncClockUs();
+    uint64_t slot = clockUs / periodUs;
+    // A fit update can pull the clock back a little over a boundary, don't
+    // send that step twice. Bigger jumps (first sync) restart the grid.
+    if (patternRestart || slot > patternSlot || slot + 1 < patternSlot) {
+        patternRestart = false;
+        patternSlot = slot;
+        lastPatternTime = now;
+        patternState = slot % pattern.stepCount;
+        sendCommand(pattern.steps[patternState]);
+        clockUs = syncClockUs(); // sending blocks for the length of the frame
+    }
+    uint64_t nextUs = (patternSlot + 1) * periodUs;
+    if (clockUs >= nextUs) return 0;
+    // Round up so we wake just after the boundary, not just before it
+    return (nextUs - clockUs + 999) / 1000;
 }
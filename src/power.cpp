@@ -0,0 +1,106 @@
+#include <Arduino.h>
+#include <esp_pm.h>
+#include <esp_idf_version.h>
+#include "power.h"
+
+const uint32_t kCpuActiveMhz = 160;
+const uint32_t kCpuIdleMhz = 80; // lowest clock Wi-Fi runs at
+
+// Rough ESP32-C3 figures (datasheet, 3.3V) for the estimate. The radio
+// listening for AP clients dominates; the CPU part shows what wakeups cost.
+const float kRadioApMa = 60.0f;
+const float kCpuIdleMa160 = 16.0f;
+const float kCpuIdleMa80 = 12.0f;
+const float kCpuActiveMa160 = 28.0f;
+const float kCpuActiveMa80 = 20.0f;
+// Context switch, cache refill and clock ramp per wakeup, not seen by micros()
+const uint32_t kWakeupOverheadUs = 30;
+
+enum class PowerMode : uint8_t { LightSleep, FrequencyScaling, Manual };
+static const char* const kPowerModeNames[] = { "auto light sleep", "auto frequency scaling", "manual" };
+
+static PowerMode powerMode = PowerMode::Manual;
+static bool idlePower = false;
+
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t wakeupCount = 0;
+static uint64_t busyMicros = 0;
+static unsigned long statsSinceMs = 0;
+static PowerStats stats = { 0, 0, 0, kCpuActiveMhz, "manual" };
+
+static bool configurePm(bool lightSleep) {
+#if ESP_IDF_VERSION_MAJOR >= 5 || CONFIG_IDF_TARGET_ESP32C3
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t config = {};
+#else
+  esp_pm_config_esp32c3_t config = {};
+#endif
+  config.max_freq_mhz = kCpuActiveMhz;
+  config.min_freq_mhz = kCpuIdleMhz;
+  config.light_sleep_enable = lightSleep;
+  return esp_pm_configure(&config) == ESP_OK;
+#else
+  return false;
+#endif
+}
+
+void initPowerManagement() {
+  // Light sleep needs an SDK built with tickless idle, fall back step by step
+  if (configurePm(true)) {
+    powerMode = PowerMode::LightSleep;
+  } else if (configurePm(false)) {
+    powerMode = PowerMode::FrequencyScaling;
+  } else {
+    powerMode = PowerMode::Manual;
+  }
+  stats.mode = kPowerModeNames[static_cast<uint8_t>(powerMode)];
+  statsSinceMs = millis();
+  Serial.printf("Power management: %s\n", stats.mode);
+}
+
+void setIdlePower(bool idle) {
+  if (idle == idlePower) return;
+  idlePower = idle;
+  // The PM driver already drops the clock whenever all tasks are blocked
+  if (powerMode == PowerMode::Manual) {
+    setCpuFrequencyMhz(idle ? kCpuIdleMhz : kCpuActiveMhz);
+  }
+  Serial.println(idle ? "Idle, power saving on" : "Active, power saving off");
+}
+
+void recordWakeup(uint32_t busy) {
+  portENTER_CRITICAL(&statsMux);
+  wakeupCount++;
+  busyMicros += busy + kWakeupOverheadUs;
+  portEXIT_CRITICAL(&statsMux);
+}
+
+const PowerStats& updatePowerStats() {
+  portENTER_CRITICAL(&statsMux);
+  uint32_t wakeups = wakeupCount;
+  uint64_t busy = busyMicros;
+  wakeupCount = 0;
+  busyMicros = 0;
+  portEXIT_CRITICAL(&statsMux);
+
+  unsigned long now = millis();
+  unsigned long elapsedMs = now - statsSinceMs;
+  statsSinceMs = now;
+  if (elapsedMs == 0) return stats;
+
+  float busyFraction = (float)busy / (elapsedMs * 1000.0f);
+  if (busyFraction > 1.0f) busyFraction = 1.0f;
+
+  stats.cpuMhz = getCpuFrequencyMhz();
+  bool slow = stats.cpuMhz <= kCpuIdleMhz;
+  float idleMa = slow ? kCpuIdleMa80 : kCpuIdleMa160;
+  float activeMa = slow ? kCpuActiveMa80 : kCpuActiveMa160;
+  stats.wakeupsPerSecond = wakeups * 1000.0f / elapsedMs;
+  stats.busyPercent = busyFraction * 100.0f;
+  stats.estimatedCurrentMa = kRadioApMa + idleMa + busyFraction * (activeMa - idleMa);
+  return stats;
+}
+
+const PowerStats& powerStats() {
+  return stats;
+}
@@ -0,0 +1,34 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+// Power management and wakeup accounting. Tasks block on notifications,
+// queues and deadlines; each time one of our tasks wakes it records how long
+// it was busy so the status output can show wakeups/s and an estimate of the
+// current draw. HTTP requests, DNS and sync packets are counted too. The
+// FreeRTOS tick and the Wi-Fi driver's own wakeups are not.
+
+struct PowerStats {
+  float wakeupsPerSecond;
+  float busyPercent;
+  float estimatedCurrentMa;
+  uint32_t cpuMhz;
+  const char* mode;
+};
+
+// Enables automatic light sleep / frequency scaling if the SDK supports it,
+// otherwise the CPU clock is lowered by hand while idle
+void initPowerManagement();
+
+// Idle = no pattern running and nobody connected
+void setIdlePower(bool idle);
+
+// Call once per task wakeup with the time spent doing work
+void recordWakeup(uint32_t busyMicros);
+
+// Recomputes the stats from the counters since the previous call
+const PowerStats& updatePowerStats();
+const PowerStats& powerStats();
+
+#endif // POWER_H
@@ -0,0 +1,629 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <IRremote.hpp>
+#include "remotes.h"
+#include "ir_capture.h"
+
+// IRremote.hpp holds the library implementation, so it must only be included
+// from this file. Everything else sends through sendCommand().
+
+// JSON document slots for a table with every command field and a full
+// palette set. Names are linked from the string pool, so when serializing
+// only the code and address strings are copied into the document.
+const size_t kRemoteCommandFields = 11;
+const size_t kRemoteCodeStringSize = 11; // "0xFFFFFFFF"
+const size_t kRemoteJsonFixedStrings = 512;
+
+static constexpr size_t remoteJsonSize(size_t profiles, size_t commands, size_t patterns) {
+  return JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(profiles) + profiles * JSON_OBJECT_SIZE(5) +
+         commands * (JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(kRemoteCommandFields) +
+                     JSON_ARRAY_SIZE(kLedPaletteMax) + 2 * kRemoteCodeStringSize) +
+         patterns * (JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(kMaxPatternSteps));
+}
+
+// Loading copies every name out of the file, at most the string pool. Keys and
+// protocol/led/effect names are deduplicated by ArduinoJson and fit in
+// kRemoteJsonFixedStrings. Serializing sizes its document from the current
+// table instead, see buildJson().
+const size_t kRemoteJsonCapacity = remoteJsonSize(kMaxProfiles, kMaxCommands, kMaxPatterns) +
+                                   kRemoteStringPoolSize + kRemoteJsonFixedStrings;
+
+// Action name -> table slot. Open addressing with linear probing, sized so the
+// load factor stays below 75% and lookups are effectively constant time.
+const uint16_t kActionTableSize = 256;
+const uint8_t kSlotEmpty = 0xFF;
+const uint8_t kPatternSlotBase = kMaxCommands; // slots >= this are patterns
+static_assert(kMaxCommands + kMaxPatterns < kSlotEmpty, "slot ids must fit in a byte");
+static_assert(kActionTableSize * 3 / 4 >= kMaxCommands + kMaxPatterns, "action table too small");
+
+RemoteProfile remoteProfiles[kMaxProfiles];
+RemoteCommand remoteCommands[kMaxCommands];
+RemotePattern remotePatterns[kMaxPatterns];
+uint8_t remoteProfileCount = 0;
+uint8_t remoteCommandCount = 0;
+uint8_t remotePatternCount = 0;
+
+// Cold data (names shown in the UI) kept out of the hot command entries
+static uint16_t commandActions[kMaxCommands];
+static uint16_t commandLabels[kMaxCommands];
+static uint16_t commandStyles[kMaxCommands];
+static uint16_t patternActions[kMaxPatterns];
+static uint16_t patternLabels[kMaxPatterns];
+static uint16_t patternStyles[kMaxPatterns];
+
+static uint32_t actionHashes[kActionTableSize];
+static uint8_t actionSlots[kActionTableSize];
+
+// Profile that learned commands go into, kNoProfile until one is learned
+const uint8_t kNoProfile = 0xFF;
+static uint8_t learnedProfile = kNoProfile;
+
+static char stringPool[kRemoteStringPoolSize];
+static uint16_t stringPoolUsed = 0;
+const uint16_t kNoString = 0xFFFF;
+
+// ============================================================================
+// IR Encoders (one specialization per protocol)
+// ============================================================================
+
+template <IrProtocol P> struct IrEncoder;
+
+template <> struct IrEncoder<IrProtocol::NecMsb> {
+  static void send(const RemoteCommand& c) { IrSender.sendNECMSB(c.code, c.bits, false); }
+};
+template <> struct IrEncoder<IrProtocol::Nec> {
+  static void send(const RemoteCommand& c) { IrSender.sendNEC(c.address, c.code, c.repeats); }
+};
+template <> struct IrEncoder<IrProtocol::Samsung> {
+  static void send(const RemoteCommand& c) { IrSender.sendSamsung(c.address, c.code, c.repeats); }
+};
+template <> struct IrEncoder<IrProtocol::Sony> {
+  static void send(const RemoteCommand& c) { IrSender.sendSony(c.address, c.code, c.repeats, c.bits); }
+};
+template <> struct IrEncoder<IrProtocol::Rc5> {
+  static void send(const RemoteCommand& c) { IrSender.sendRC5(c.address, c.code, c.repeats); }
+};
+template <> struct IrEncoder<IrProtocol::Rc6> {
+  static void send(const RemoteCommand& c) { IrSender.sendRC6(c.address, c.code, c.repeats); }
+};
+template <> struct IrEncoder<IrProtocol::Jvc> {
+  static void send(const RemoteCommand& c) { IrSender.sendJVC(c.address, c.code, c.repeats); }
+};
+template <> struct IrEncoder<IrProtocol::Lg> {
+  static void send(const RemoteCommand& c) { IrSender.sendLG(c.address, c.code, c.repeats); }
+};
+template <> struct IrEncoder<IrProtocol::Panasonic> {
+  static void send(const RemoteCommand& c) { IrSender.sendPanasonic(c.address, c.code, c.repeats); }
+};
+
+typedef void (*IrSendFn)(const RemoteCommand&);
+
+// Indexed by IrProtocol, must follow the enum order
+static const IrSendFn kIrEncoders[] = {
+  &IrEncoder<IrProtocol::NecMsb>::send,
+  &IrEncoder<IrProtocol::Nec>::send,
+  &IrEncoder<IrProtocol::Samsung>::send,
+  &IrEncoder<IrProtocol::Sony>::send,
+  &IrEncoder<IrProtocol::Rc5>::send,
+  &IrEncoder<IrProtocol::Rc6>::send,
+  &IrEncoder<IrProtocol::Jvc>::send,
+  &IrEncoder<IrProtocol::Lg>::send,
+  &IrEncoder<IrProtocol::Panasonic>::send,
+};
+static_assert(sizeof(kIrEncoders) / sizeof(kIrEncoders[0]) == kIrProtocolCount,
+              "every IrProtocol needs an encoder");
+
+// Default frame length when a command doesn't give "bits"
+static uint8_t defaultBits(IrProtocol protocol) {
+  switch (protocol) {
+    case IrProtocol::NecMsb: return 32;
+    case IrProtocol::Sony: return 12;
+    default: return 0; // fixed by the protocol
+  }
+}
+
+// ============================================================================
+// String Pool and Action Table
+// ============================================================================
+
+static uint16_t internString(const char* str) {
+  if (str == nullptr) str = "";
+  size_t len = strlen(str) + 1;
+  if (stringPoolUsed + len > kRemoteStringPoolSize) return kNoString;
+  uint16_t offset = stringPoolUsed;
+  memcpy(stringPool + offset, str, len);
+  stringPoolUsed += len;
+  return offset;
+}
+
+static const char* poolString(uint16_t offset) {
+  return offset == kNoString ? "" : stringPool + offset;
+}
+
+// FNV-1a
+static uint32_t hashAction(const char* str) {
+  uint32_t hash = 2166136261u;
+  while (*str) {
+    hash ^= (uint8_t)*str++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static const char* slotAction(uint8_t slot) {
+  if (slot >= kPatternSlotBase) return poolString(patternActions[slot - kPatternSlotBase]);
+  return poolString(commandActions[slot]);
+}
+
+static uint8_t lookupAction(const char* action) {
+  uint32_t hash = hashAction(action);
+  uint16_t i = hash & (kActionTableSize - 1);
+  while (actionSlots[i] != kSlotEmpty) {
+    if (actionHashes[i] == hash && strcmp(slotAction(actionSlots[i]), action) == 0) {
+      return actionSlots[i];
+    }
+    i = (i + 1) & (kActionTableSize - 1);
+  }
+  return kSlotEmpty;
+}
+
+// Returns false if the action name is already taken
+static bool insertAction(const char* action, uint8_t slot) {
+  uint32_t hash = hashAction(action);
+  uint16_t i = hash & (kActionTableSize - 1);
+  while (actionSlots[i] != kSlotEmpty) {
+    if (actionHashes[i] == hash && strcmp(slotAction(actionSlots[i]), action) == 0) {
+      return false;
+    }
+    i = (i + 1) & (kActionTableSize - 1);
+  }
+  actionHashes[i] = hash;
+  actionSlots[i] = slot;
+  return true;
+}
+
+int findCommand(const char* action) {
+  uint8_t slot = lookupAction(action);
+  return slot < kPatternSlotBase ? slot : -1;
+}
+
+int findPattern(const char* action) {
+  uint8_t slot = lookupAction(action);
+  return (slot != kSlotEmpty && slot >= kPatternSlotBase) ? slot - kPatternSlotBase : -1;
+}
+
+const char* commandAction(uint8_t index) {
+  return index < remoteCommandCount ? poolString(commandActions[index]) : "";
+}
+
+const char* patternAction(uint8_t index) {
+  return index < remotePatternCount ? poolString(patternActions[index]) : "";
+}
+
+// ============================================================================
+// Loading
+// ============================================================================
+
+static uint8_t parseLed(const char* name) {
+  if (name == nullptr) return kLedNone;
+  if (strcmp(name, "off") == 0) return 0;
+  if (strcmp(name, "red") == 0) return kLedRed;
+  if (strcmp(name, "green") == 0) return kLedGreen;
+  if (strcmp(name, "blue") == 0) return kLedBlue;
+  if (strcmp(name, "yellow") == 0) return kLedRed | kLedGreen;
+  if (strcmp(name, "cyan") == 0) return kLedGreen | kLedBlue;
+  if (strcmp(name, "magenta") == 0) return kLedRed | kLedBlue;
+  if (strcmp(name, "white") == 0) return kLedRed | kLedGreen | kLedBlue;
+  return kLedNone;
+}
+
+static const char* ledName(uint8_t led) {
+  static const char* const names[] = {
+    "off", "red", "green", "yellow", "blue", "magenta", "cyan", "white"
+  };
+  return led < 8 ? names[led] : nullptr;
+}
+
+// "colors": ["red", "green", "blue"] for cycling effects
+static uint32_t parsePalette(JsonArrayConst colors) {
+  uint32_t palette = 0;
+  for (const char* name : colors) {
+    uint8_t led = parseLed(name);
+    if (led != kLedNone) palette = ledPaletteAdd(palette, led);
+  }
+  return palette;
+}
+
+// Codes are hex strings in the JSON ("0xFF10EF") but plain numbers work too
+static uint32_t parseCode(JsonVariantConst value) {
+  if (value.is<const char*>()) return strtoul(value.as<const char*>(), nullptr, 0);
+  return value.as<uint32_t>();
+}
+
+static void clearRemotes() {
+  remoteProfileCount = 0;
+  remoteCommandCount = 0;
+  remotePatternCount = 0;
+  stringPoolUsed = 0;
+  learnedProfile = kNoProfile;
+  memset(actionSlots, kSlotEmpty, sizeof(actionSlots));
+}
+
+// Entry and names are written before the action is published in the lookup
+// table, and the count is bumped last, so the web task never sees a half
+// written command
+static bool appendCommand(const char* action, const char* label, const char* style,
+                          const RemoteCommand& entry) {
+  if (remoteCommandCount >= kMaxCommands) {
+    Serial.printf("Too many remote commands, '%s' skipped\n", action);
+    return false;
+  }
+  uint8_t index = remoteCommandCount;
+  uint16_t actionStr = internString(action);
+  uint16_t labelStr = internString(label);
+  uint16_t styleStr = internString(style);
+  if (actionStr == kNoString || labelStr == kNoString || styleStr == kNoString) {
+    Serial.println("Remote string pool full");
+    return false;
+  }
+  commandActions[index] = actionStr;
+  commandLabels[index] = labelStr;
+  commandStyles[index] = styleStr;
+  remoteCommands[index] = entry;
+  if (!insertAction(action, index)) {
+    Serial.printf("Duplicate action '%s', skipped\n", action);
+    return false;
+  }
+  remoteCommandCount++;
+  return true;
+}
+
+static bool addCommand(JsonObjectConst json, uint8_t profile, IrProtocol defaultProtocol) {
+  const char* action = json["action"];
+  if (action == nullptr || json["code"].isNull()) {
+    Serial.println("Remote command needs 'action' and 'code', skipped");
+    return false;
+  }
+
+  IrProtocol protocol = defaultProtocol;
+  if (!json["protocol"].isNull() && !parseIrProtocol(json["protocol"], protocol)) {
+    Serial.printf("Unknown protocol for '%s', skipped\n", action);
+    return false;
+  }
+
+  // A colour on its own means the props show that colour
+  LedEffect effect = json["led"].isNull() ? LedEffect::None : LedEffect::Static;
+  if (!json["effect"].isNull() && !parseLedEffect(json["effect"], effect)) {
+    Serial.printf("Unknown effect for '%s', ignored\n", action);
+  }
+
+  RemoteCommand command;
+  command.code = parseCode(json["code"]);
+  command.address = parseCode(json["address"]);
+  command.protocol = static_cast<uint8_t>(protocol);
+  command.bits = json["bits"] | defaultBits(protocol);
+  command.repeats = json["repeats"] | 0;
+  command.led = parseLed(json["led"]);
+  command.profile = profile;
+  command.effect = static_cast<uint8_t>(effect);
+  command.palette = parsePalette(json["colors"]);
+  return appendCommand(action, json["label"] | action, json["style"] | "gray", command);
+}
+
+// Patterns reference commands by action, so they are resolved after every
+// profile's commands are in the table
+static bool addPattern(JsonObjectConst json, uint8_t profile) {
+  const char* action = json["action"];
+  JsonArrayConst steps = json["steps"];
+  if (action == nullptr || steps.isNull() || steps.size() == 0) {
+    Serial.println("Remote pattern needs 'action' and 'steps', skipped");
+    return false;
+  }
+  if (remotePatternCount >= kMaxPatterns) {
+    Serial.printf("Too many patterns, '%s' skipped\n", action);
+    return false;
+  }
+
+  uint8_t index = remotePatternCount;
+  RemotePattern& pattern = remotePatterns[index];
+  pattern.stepCount = 0;
+  pattern.profile = profile;
+  for (const char* step : steps) {
+    int command = step ? findCommand(step) : -1;
+    if (command < 0 || pattern.stepCount >= kMaxPatternSteps) {
+      Serial.printf("Bad step '%s' in pattern '%s', skipped\n", step ? step : "", action);
+      return false;
+    }
+    pattern.steps[pattern.stepCount++] = command;
+  }
+
+  uint16_t actionStr = internString(action);
+  uint16_t labelStr = internString(json["label"] | action);
+  uint16_t styleStr = internString(json["style"] | "gray");
+  if (actionStr == kNoString || labelStr == kNoString || styleStr == kNoString) {
+    Serial.println("Remote string pool full");
+    return false;
+  }
+  patternActions[index] = actionStr;
+  patternLabels[index] = labelStr;
+  patternStyles[index] = styleStr;
+  if (!insertAction(action, kPatternSlotBase + index)) {
+    Serial.printf("Duplicate action '%s', skipped\n", action);
+    return false;
+  }
+  remotePatternCount++;
+  return true;
+}
+
+static bool readJson(const char* path, DynamicJsonDocument& doc) {
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    Serial.printf("Failed to open %s\n", path);
+    return false;
+  }
+  if (doc.capacity() == 0) {
+    file.close();
+    Serial.printf("Not enough memory to load %s\n", path);
+    return false;
+  }
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  if (error) {
+    Serial.printf("Failed to parse %s: %s\n", path, error.c_str());
+    return false;
+  }
+  return true;
+}
+
+static bool parseProfileProtocol(JsonObjectConst json, IrProtocol& protocol) {
+  protocol = IrProtocol::NecMsb;
+  return json["protocol"].isNull() || parseIrProtocol(json["protocol"], protocol);
+}
+
+static void loadProfiles(JsonArrayConst profiles) {
+  for (JsonObjectConst json : profiles) {
+    if (remoteProfileCount >= kMaxProfiles) {
+      Serial.println("Too many remote profiles, rest skipped");
+      break;
+    }
+    IrProtocol protocol;
+    if (!parseProfileProtocol(json, protocol)) {
+      Serial.printf("Unknown protocol for profile '%s', skipped\n", json["id"] | "");
+      continue;
+    }
+    RemoteProfile& profile = remoteProfiles[remoteProfileCount];
+    const char* id = json["id"] | "remote";
+    profile.id = internString(id);
+    profile.name = internString(json["name"] | id);
+    profile.protocol = static_cast<uint8_t>(protocol);
+    for (JsonObjectConst command : json["commands"].as<JsonArrayConst>()) {
+      addCommand(command, remoteProfileCount, protocol);
+    }
+    remoteProfileCount++;
+  }
+
+  // Skip the same profiles as above so patterns land in the right one
+  uint8_t profileIndex = 0;
+  for (JsonObjectConst json : profiles) {
+    if (profileIndex >= remoteProfileCount) break;
+    IrProtocol protocol;
+    if (!parseProfileProtocol(json, protocol)) continue;
+    for (JsonObjectConst pattern : json["patterns"].as<JsonArrayConst>()) {
+      addPattern(pattern, profileIndex);
+    }
+    profileIndex++;
+  }
+}
+
+// Profile for learned commands, created on first use
+static int learnedProfileIndex() {
+  if (learnedProfile != kNoProfile) return learnedProfile;
+  if (remoteProfileCount >= kMaxProfiles) {
+    Serial.println("No room for the learned remote profile");
+    return -1;
+  }
+  RemoteProfile& learned = remoteProfiles[remoteProfileCount];
+  learned.id = internString(kLearnedProfileId);
+  learned.name = internString("Learned");
+  learned.protocol = static_cast<uint8_t>(IrProtocol::NecMsb);
+  learnedProfile = remoteProfileCount++;
+  return learnedProfile;
+}
+
+static void loadLearned(JsonArrayConst commands) {
+  if (commands.isNull() || commands.size() == 0) return;
+  int profile = learnedProfileIndex();
+  if (profile < 0) return;
+  for (JsonObjectConst command : commands) {
+    addCommand(command, profile, IrProtocol::NecMsb);
+  }
+}
+
+bool loadRemotes(const char* path) {
+  clearRemotes();
+
+  {
+    DynamicJsonDocument doc(kRemoteJsonCapacity);
+    if (readJson(path, doc)) {
+      loadProfiles(doc["profiles"]);
+    }
+  }
+  // Learned commands are merged in from their own file, so learning never
+  // rewrites remotes.json and can't lose anything this load skipped
+  if (LittleFS.exists(kLearnedPath)) {
+    DynamicJsonDocument doc(kRemoteJsonCapacity);
+    if (readJson(kLearnedPath, doc)) {
+      loadLearned(doc["commands"]);
+    }
+  }
+
+  Serial.printf("Loaded %u remotes, %u commands, %u patterns (%u bytes of names)\n",
+                remoteProfileCount, remoteCommandCount, remotePatternCount, stringPoolUsed);
+  return remoteCommandCount > 0;
+}
+
+bool addLearnedCommand(const char* action, const char* label, IrProtocol protocol,
+                       uint32_t code, uint16_t address, uint8_t bits) {
+  if (lookupAction(action) != kSlotEmpty) {
+    Serial.printf("Action '%s' already exists\n", action);
+    return false;
+  }
+  int profile = learnedProfileIndex();
+  if (profile < 0) return false;
+
+  RemoteCommand command;
+  command.code = code;
+  command.address = address;
+  command.protocol = static_cast<uint8_t>(protocol);
+  command.bits = bits ? bits : defaultBits(protocol);
+  command.repeats = 0;
+  command.led = kLedNone;
+  command.profile = profile;
+  command.effect = static_cast<uint8_t>(LedEffect::None);
+  command.palette = 0;
+  if (!appendCommand(action, label, "gray", command)) return false;
+
+  Serial.printf("Learned %s: %s 0x%lX address 0x%X\n", action, irProtocolName(protocol),
+                (unsigned long)code, address);
+  return true;
+}
+
+bool initRemotes(uint16_t irLedPin, const char* path) {
+  IrSender.begin(irLedPin);
+  return loadRemotes(path);
+}
+
+// ============================================================================
+// Sending and Serialization
+// ============================================================================
+
+void sendCommand(uint8_t index) {
+  if (index >= remoteCommandCount) return;
+  const RemoteCommand& command = remoteCommands[index];
+  Serial.printf("Sending %s\n", poolString(commandActions[index]));
+  showLedEffect(static_cast<LedEffect>(command.effect), command.led, command.palette);
+  setIrTransmitting(true);
+  kIrEncoders[command.protocol](command);
+  setIrTransmitting(false);
+}
+
+// Writes one command in remotes.json form. The protocol is left out when it
+// matches the profile default (pass IrProtocol::Count to always write it).
+static void addCommandJson(JsonObject json, uint8_t i, IrProtocol defaultProtocol) {
+  const RemoteCommand& command = remoteCommands[i];
+  IrProtocol protocol = static_cast<IrProtocol>(command.protocol);
+  char buf[12];
+  json["action"] = poolString(commandActions[i]);
+  json["label"] = poolString(commandLabels[i]);
+  json["style"] = poolString(commandStyles[i]);
+  if (protocol != defaultProtocol) {
+    json["protocol"] = irProtocolName(protocol);
+  }
+  snprintf(buf, sizeof(buf), "0x%lX", (unsigned long)command.code);
+  json["code"] = buf;
+  if (command.address != 0) {
+    snprintf(buf, sizeof(buf), "0x%X", command.address);
+    json["address"] = buf;
+  }
+  if (command.bits != defaultBits(protocol)) json["bits"] = command.bits;
+  if (command.repeats != 0) json["repeats"] = command.repeats;
+  if (ledName(command.led)) json["led"] = ledName(command.led);
+  LedEffect effect = static_cast<LedEffect>(command.effect);
+  if (effect != LedEffect::None &&
+      !(effect == LedEffect::Static && ledName(command.led))) {
+    json["effect"] = ledEffectName(effect);
+  }
+  uint8_t colors = ledPaletteSize(command.palette);
+  if (colors > 0) {
+    JsonArray palette = json.createNestedArray("colors");
+    for (uint8_t c = 0; c < colors; c++) {
+      palette.add(ledName(ledPaletteColor(command.palette, c)));
+    }
+  }
+}
+
+static void addRemotesJson(JsonDocument& doc) {
+  JsonArray profiles = doc.createNestedArray("profiles");
+
+  for (uint8_t p = 0; p < remoteProfileCount; p++) {
+    const RemoteProfile& profile = remoteProfiles[p];
+    JsonObject jsonProfile = profiles.createNestedObject();
+    jsonProfile["id"] = poolString(profile.id);
+    jsonProfile["name"] = poolString(profile.name);
+    jsonProfile["protocol"] = irProtocolName(static_cast<IrProtocol>(profile.protocol));
+
+    JsonArray commands = jsonProfile.createNestedArray("commands");
+    for (uint8_t i = 0; i < remoteCommandCount; i++) {
+      if (remoteCommands[i].profile != p) continue;
+      addCommandJson(commands.createNestedObject(), i, static_cast<IrProtocol>(profile.protocol));
+    }
+
+    JsonArray patterns = jsonProfile.createNestedArray("patterns");
+    for (uint8_t i = 0; i < remotePatternCount; i++) {
+      const RemotePattern& pattern = remotePatterns[i];
+      if (pattern.profile != p) continue;
+      JsonObject json = patterns.createNestedObject();
+      json["action"] = poolString(patternActions[i]);
+      json["label"] = poolString(patternLabels[i]);
+      json["style"] = poolString(patternStyles[i]);
+      JsonArray steps = json.createNestedArray("steps");
+      for (uint8_t s = 0; s < pattern.stepCount; s++) {
+        steps.add(poolString(commandActions[pattern.steps[s]]));
+      }
+    }
+  }
+}
+
+// learned.json is a flat command list with the protocol always given
+static void addLearnedJson(JsonDocument& doc) {
+  JsonArray commands = doc.createNestedArray("commands");
+  for (uint8_t i = 0; i < remoteCommandCount; i++) {
+    if (learnedProfile == kNoProfile || remoteCommands[i].profile != learnedProfile) continue;
+    addCommandJson(commands.createNestedObject(), i, IrProtocol::Count);
+  }
+}
+
+static uint8_t learnedCommandCount() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < remoteCommandCount; i++) {
+    if (learnedProfile != kNoProfile && remoteCommands[i].profile == learnedProfile) count++;
+  }
+  return count;
+}
+
+// False if the document couldn't be allocated or the table didn't fit, a
+// partial table must never be sent or saved
+static bool buildJson(DynamicJsonDocument& doc, void (*fill)(JsonDocument&)) {
+  if (doc.capacity() == 0) {
+    Serial.println("Not enough memory to serialize remotes");
+    return false;
+  }
+  fill(doc);
+  if (doc.overflowed()) {
+    Serial.println("Remotes JSON overflowed");
+    return false;
+  }
+  return true;
+}
+
+bool serializeRemotes(Print& out) {
+  DynamicJsonDocument doc(remoteJsonSize(remoteProfileCount, remoteCommandCount, remotePatternCount));
+  if (!buildJson(doc, addRemotesJson)) return false;
+  serializeJson(doc, out);
+  return true;
+}
+
+bool saveLearnedCommands(const char* path) {
+  DynamicJsonDocument doc(remoteJsonSize(0, learnedCommandCount(), 0));
+  if (!buildJson(doc, addLearnedJson)) return false;
+  File file = LittleFS.open(path, "w");
+  if (!file) {
+    Serial.printf("Failed to open %s for writing\n", path);
+    return false;
+  }
+  bool ok = serializeJsonPretty(doc, file) > 0;
+  file.close();
+  Serial.printf(ok ? "Saved learned commands to %s\n" : "Failed to write %s\n", path);
+  return ok;
+}
@@ -0,0 +1,81 @@
+#ifndef REMOTES_H
+#define REMOTES_H
+
+#include <Arduino.h>
+#include "ir_protocol.h"
+#include "feedback_led.h"
+
+// Remote profiles are loaded from /remotes.json at boot and compiled into the
+// flat tables below. Capacities are fixed so lookups and sends never allocate.
+const uint8_t kMaxProfiles = 8;
+const uint8_t kMaxCommands = 160;
+const uint8_t kMaxPatterns = 32;
+const uint8_t kMaxPatternSteps = 8;
+const uint16_t kRemoteStringPoolSize = 8192;
+
+const char* const kRemotesPath = "/remotes.json";
+
+// Profile that commands captured in learn mode are added to, stored in its
+// own file and merged in when the remotes are loaded
+const char* const kLearnedProfileId = "learned";
+const char* const kLearnedPath = "/learned.json";
+
+// Hot data needed to transmit a command, 16 bytes per entry
+struct RemoteCommand {
+  uint32_t code;      // full frame for NEC_MSB, command for everything else
+  uint16_t address;
+  uint8_t protocol;   // IrProtocol
+  uint8_t bits;
+  uint8_t repeats;
+  uint8_t led;        // kLed* colour mask or kLedNone
+  uint8_t profile;
+  uint8_t effect;     // LedEffect the props switch to
+  uint32_t palette;   // colours for cycling effects, see ledPaletteAdd()
+};
+
+// A strobe pattern cycles through commands every color_pair_delay ms
+struct RemotePattern {
+  uint8_t steps[kMaxPatternSteps]; // command indices
+  uint8_t stepCount;
+  uint8_t profile;
+};
+
+struct RemoteProfile {
+  uint16_t id;        // string pool offsets
+  uint16_t name;
+  uint8_t protocol;   // default for commands that don't set one
+};
+
+extern RemoteProfile remoteProfiles[kMaxProfiles];
+extern RemoteCommand remoteCommands[kMaxCommands];
+extern RemotePattern remotePatterns[kMaxPatterns];
+extern uint8_t remoteProfileCount;
+extern uint8_t remoteCommandCount;
+extern uint8_t remotePatternCount;
+
+// Starts the IR sender and loads the profiles (plus learned.json)
+bool initRemotes(uint16_t irLedPin, const char* path);
+bool loadRemotes(const char* path);
+
+// Constant-time lookup by action name, -1 if unknown
+int findCommand(const char* action);
+int findPattern(const char* action);
+
+const char* commandAction(uint8_t index);
+const char* patternAction(uint8_t index);
+
+void sendCommand(uint8_t index);
+
+// Serializes the compiled table back to remotes.json format (used by /remotes).
+// Fails before writing anything rather than send a truncated table.
+bool serializeRemotes(Print& out);
+
+// Writes the learned profile's commands to learned.json. remotes.json itself
+// is never rewritten by the firmware.
+bool saveLearnedCommands(const char* path);
+
+// Adds a captured code as a new command in the "learned" profile
+bool addLearnedCommand(const char* action, const char* label, IrProtocol protocol,
+                       uint32_t code, uint16_t address, uint8_t bits);
+
+#endif // REMOTES_H
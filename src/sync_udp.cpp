@@ -0,0 +1,243 @@
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "sync_udp.h"
+#include "power.h"
+
+// Defined in main.cpp
+extern unsigned long color_pair_delay;
+void wakeMainTask();
+
+const uint64_t kAnnounceIntervalUs = 1000000;
+const uint64_t kRequestIntervalUs = 250000; // while acquiring
+const uint8_t kRequestDivider = 4;          // once synced, every 4th tick
+
+static const char* const kSyncRoleNames[] = { "off", "leader", "follower" };
+
+static SyncRole syncRole = SyncRole::Off;
+static AsyncUDP syncUdp;
+static esp_timer_handle_t syncTimer = NULL;
+static TaskHandle_t syncTaskHandle = NULL;
+static uint32_t syncId = 0;
+static uint16_t announceSequence = 0;
+
+// Follower state is shared by the UDP callback, the timer and the pattern
+// scheduler. A mutex rather than a critical section: the fit is soft float
+// and would keep interrupts off for too long.
+static SyncFollower follower;
+static SemaphoreHandle_t followerMutex = NULL;
+static IPAddress leaderIp;
+static uint8_t requestTick = 0;
+
+// ============================================================================
+// Role Config
+// ============================================================================
+
+const char* syncRoleName(SyncRole role) {
+  uint8_t index = static_cast<uint8_t>(role);
+  return index <= static_cast<uint8_t>(SyncRole::Follower) ? kSyncRoleNames[index] : "off";
+}
+
+bool parseSyncRole(const char* name, SyncRole& role) {
+  if (name == nullptr) return false;
+  for (uint8_t i = 0; i <= static_cast<uint8_t>(SyncRole::Follower); i++) {
+    if (strcmp(name, kSyncRoleNames[i]) == 0) {
+      role = static_cast<SyncRole>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+SyncRole loadSyncRole() {
+  File file = LittleFS.open(kSyncConfigPath, "r");
+  if (!file) return SyncRole::Off; // never configured
+  StaticJsonDocument<128> doc;
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  SyncRole role = SyncRole::Off;
+  if (error || !parseSyncRole(doc["role"] | "", role)) {
+    Serial.printf("Invalid %s, clock sync off\n", kSyncConfigPath);
+    return SyncRole::Off;
+  }
+  return role;
+}
+
+bool saveSyncRole(SyncRole role) {
+  StaticJsonDocument<128> doc;
+  doc["role"] = syncRoleName(role);
+  File file = LittleFS.open(kSyncConfigPath, "w");
+  if (!file) {
+    Serial.printf("Failed to open %s for writing\n", kSyncConfigPath);
+    return false;
+  }
+  bool ok = serializeJson(doc, file) > 0;
+  file.close();
+  return ok;
+}
+
+// ============================================================================
+// Leader
+// ============================================================================
+
+static void onLeaderPacket(AsyncUDPPacket& packet) {
+  uint64_t rxUs = esp_timer_get_time();
+  uint32_t busyStart = micros();
+  SyncMessage request;
+  if (!decodeSyncMessage(packet.data(), packet.length(), request) ||
+      request.type != SyncMessageType::DelayRequest || request.targetId != syncId) {
+    return;
+  }
+  uint8_t buffer[kSyncMessageSize];
+  encodeSyncMessage(makeDelayResponse(request, syncId, rxUs, esp_timer_get_time()),
+                    buffer, sizeof(buffer));
+  packet.write(buffer, sizeof(buffer));
+  recordWakeup(micros() - busyStart);
+}
+
+static void sendAnnounce() {
+  uint8_t buffer[kSyncMessageSize];
+  encodeSyncMessage(makeAnnounce(syncId, ++announceSequence, esp_timer_get_time(), color_pair_delay),
+                    buffer, sizeof(buffer));
+  syncUdp.broadcastTo(buffer, sizeof(buffer), kSyncPort, TCPIP_ADAPTER_IF_AP);
+}
+
+// ============================================================================
+// Follower
+// ============================================================================
+
+static void onFollowerPacket(AsyncUDPPacket& packet) {
+  uint64_t rxUs = esp_timer_get_time();
+  uint32_t busyStart = micros();
+  SyncMessage message;
+  if (!decodeSyncMessage(packet.data(), packet.length(), message)) return;
+
+  uint32_t periodMs = 0;
+  xSemaphoreTake(followerMutex, portMAX_DELAY);
+  if (message.type == SyncMessageType::Announce) {
+    if (follower.onAnnounce(message, rxUs)) {
+      leaderIp = packet.remoteIP();
+      periodMs = message.periodMs;
+    }
+  } else if (message.type == SyncMessageType::DelayResponse) {
+    follower.onDelayResponse(message, rxUs);
+  }
+  xSemaphoreGive(followerMutex);
+
+  // Follow the leader's speed so both run on the same step grid
+  if (periodMs >= 100 && periodMs <= 5000 && periodMs != color_pair_delay) {
+    color_pair_delay = periodMs;
+    Serial.printf("Speed set to %lums by the leader\n", color_pair_delay);
+    wakeMainTask();
+  }
+  recordWakeup(micros() - busyStart);
+}
+
+static void sendDelayRequest() {
+  uint8_t buffer[kSyncMessageSize];
+  bool due = false;
+  IPAddress ip;
+  xSemaphoreTake(followerMutex, portMAX_DELAY);
+  if (follower.hasLeader()) {
+    requestTick++;
+    due = !follower.synced(esp_timer_get_time()) || requestTick % kRequestDivider == 0;
+    if (due) {
+      ip = leaderIp;
+      encodeSyncMessage(follower.makeDelayRequest(esp_timer_get_time()), buffer, sizeof(buffer));
+    }
+  }
+  xSemaphoreGive(followerMutex);
+  if (due) {
+    syncUdp.writeTo(buffer, sizeof(buffer), ip, kSyncPort);
+  }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+// esp_timer callbacks share one high priority task and must not block, so
+// the timer only wakes this task. Taking the follower mutex (held during the
+// fit) and AsyncUDP sends (which wait for the lwIP thread) happen here.
+static void syncTask(void* parameter) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint32_t busyStart = micros();
+    if (syncRole == SyncRole::Leader) {
+      sendAnnounce();
+    } else {
+      sendDelayRequest();
+    }
+    recordWakeup(micros() - busyStart);
+  }
+}
+
+static void onSyncTimer(void* arg) {
+  xTaskNotifyGive(syncTaskHandle);
+}
+
+void startClockSync(SyncRole role) {
+  syncRole = role;
+  if (role == SyncRole::Off) return;
+
+  // Last four MAC bytes, the first ones are the vendor prefix
+  syncId = (uint32_t)(ESP.getEfuseMac() >> 16);
+  if (syncId == 0) syncId = 1;
+  follower = SyncFollower(syncId);
+  followerMutex = xSemaphoreCreateMutex();
+
+  if (!syncUdp.listen(kSyncPort)) {
+    Serial.println("Clock sync UDP failed to start");
+    syncRole = SyncRole::Off;
+    return;
+  }
+  syncUdp.onPacket(role == SyncRole::Leader ? onLeaderPacket : onFollowerPacket);
+
+  xTaskCreate(syncTask, "Clock Sync", 3072, NULL, 2, &syncTaskHandle);
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = onSyncTimer;
+  timerArgs.name = "clock sync";
+  esp_timer_create(&timerArgs, &syncTimer);
+  esp_timer_start_periodic(syncTimer, role == SyncRole::Leader ? kAnnounceIntervalUs : kRequestIntervalUs);
+  Serial.printf("Clock sync started as %s (id %08lX)\n", syncRoleName(role), (unsigned long)syncId);
+}
+
+SyncRole clockSyncRole() {
+  return syncRole;
+}
+
+uint64_t syncClockUs() {
+  uint64_t localUs = esp_timer_get_time();
+  if (syncRole != SyncRole::Follower) return localUs;
+  // Once synced, keep using the last fit if the leader goes quiet rather than
+  // jumping back to the local clock mid pattern
+  xSemaphoreTake(followerMutex, portMAX_DELAY);
+  uint64_t clockUs = follower.accepted >= kSyncMinSamples ? follower.toLeader(localUs) : localUs;
+  xSemaphoreGive(followerMutex);
+  return clockUs;
+}
+
+SyncStatus syncStatus() {
+  SyncStatus status = {};
+  status.role = syncRole;
+  if (syncRole != SyncRole::Follower) {
+    status.synced = syncRole == SyncRole::Leader;
+    return status;
+  }
+  uint64_t localUs = esp_timer_get_time();
+  xSemaphoreTake(followerMutex, portMAX_DELAY);
+  status.synced = follower.synced(localUs);
+  status.offsetUs = follower.offsetUs(localUs);
+  status.driftPpm = follower.driftPpm();
+  status.errorUs = follower.errorUs();
+  status.delayUs = follower.lastDelayUs;
+  status.accepted = follower.accepted;
+  status.rejected = follower.rejected;
+  xSemaphoreGive(followerMutex);
+  return status;
+}
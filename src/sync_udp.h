@@ -0,0 +1,47 @@
+#ifndef SYNC_UDP_H
+#define SYNC_UDP_H
+
+#include <Arduino.h>
+#include "clock_sync.h"
+
+// Runs the clock sync protocol (clock_sync.h) over UDP so several remotes
+// step their patterns in phase. One unit is the leader; followers join its
+// access point as a station and keep their own AP (on another subnet) for
+// the operator. The role is kept in /sync.json and changing it restarts.
+
+enum class SyncRole : uint8_t { Off, Leader, Follower };
+
+const char* const kSyncConfigPath = "/sync.json";
+// The leader's AP has its own name, so followers can't join a unit that has
+// sync off (every unconfigured one) and wait there for announces forever
+const char* const kSyncLeaderSsid = "K8_RGB_IR_SYNC";
+const char* const kSyncLeaderPassword = "SmartOne";
+
+struct SyncStatus {
+  SyncRole role;
+  bool synced;
+  double offsetUs;    // leader - local
+  double driftPpm;
+  double errorUs;     // RMS of the accepted exchanges around the fit
+  uint32_t delayUs;   // last round trip
+  uint32_t accepted;
+  uint32_t rejected;
+};
+
+// Reads the role from /sync.json, call before WiFi is set up
+SyncRole loadSyncRole();
+bool saveSyncRole(SyncRole role);
+const char* syncRoleName(SyncRole role);
+bool parseSyncRole(const char* name, SyncRole& role);
+
+// Starts the UDP socket and timers once WiFi is up
+void startClockSync(SyncRole role);
+SyncRole clockSyncRole();
+
+// Pattern clock: leader time on a follower that has synced at least once,
+// the local clock otherwise
+uint64_t syncClockUs();
+
+SyncStatus syncStatus();
+
+#endif // SYNC_UDP_H
@@ -4,12 +4,13 @@
 #include <LittleFS.h>
 #include <ESPAsyncWebServer.h>
 #include <ElegantOTA.h>
-#include <DNSServer.h>
 #include <ArduinoJson.h>
+#include "ir_capture.h"
+#include "power.h"
+#include "sync_udp.h"
 
 // Global variables (defined in main.cpp)
 extern AsyncWebServer server;
-extern DNSServer dnsServer;
 extern bool otaInProgress;
 extern bool captivePortalActive;
 
@@ -25,8 +26,10 @@ extern const uint16_t rPin;
 extern const uint16_t gPin;
 extern const uint16_t bPin;
 
-// DNS server IP (captive portal) - using AP default
-const byte DNS_PORT = 53;
+// Task handles (from main.cpp)
+extern TaskHandle_t elegantOTATaskHandle;
+
+// AP address - using AP default
 IPAddress apIP(192, 168, 4, 1);
 IPAddress netMask(255, 255, 255, 0);
 
@@ -118,47 +121,19 @@ void handleAction(AsyncWebServerRequest *request) {
   
   String action = request->getParam("do")->value();
   
-  // Handle all actions - same as original handleAction() function
-  // We'll call the appropriate functions which are defined in main.cpp
-  if (action == "red") { currentPattern = 0; patternState = 0; Red(); }
-  else if (action == "green") { currentPattern = 0; patternState = 0; Green(); }
-  else if (action == "blue") { currentPattern = 0; patternState = 0; Blue(); }
-  else if (action == "yellow") { currentPattern = 0; patternState = 0; Yellow(); }
-  else if (action == "cyan") { currentPattern = 0; patternState = 0; Cyan(); }
-  else if (action == "magenta") { currentPattern = 0; patternState = 0; Magenta(); }
-  else if (action == "white") { currentPattern = 0; patternState = 0; White(); }
-  else if (action == "off") { currentPattern = 0; patternState = 0; Off(); }
-  else if (action == "fade") { currentPattern = 0; patternState = 0; Fade(); }
-  else if (action == "strobeplus") { currentPattern = 0; patternState = 0; Strobeplus(); }
-  else if (action == "rgbstrobe") { currentPattern = 0; patternState = 0; RGBStrobe(); }
-  else if (action == "rainbow") { currentPattern = 0; patternState = 0; Rainbow(); }
-  else if (action == "halfstrobe") { currentPattern = 0; patternState = 0; Halfstrobe(); }
-  else if (action == "bgstrobe") { currentPattern = 0; patternState = 0; BGStrobe(); }
-  else if (action == "grstrobe") { currentPattern = 0; patternState = 0; GRStrobe(); }
-  else if (action == "next") { currentPattern = 0; patternState = 0; Next(); }
-  else if (action == "demo") { currentPattern = 0; patternState = 0; Demo(); }
-  else if (action == "previous") { currentPattern = 0; patternState = 0; Previous(); }
-  else if (action == "chinese_red") { currentPattern = 0; patternState = 0; ChineseRed(); }
-  else if (action == "chinese_green") { currentPattern = 0; patternState = 0; ChineseGreen(); }
-  else if (action == "chinese_blue") { currentPattern = 0; patternState = 0; ChineseBlue(); }
-  else if (action == "chinese_white") { currentPattern = 0; patternState = 0; ChineseWhite(); }
-  else if (action == "chinese_brt_up") { currentPattern = 0; patternState = 0; ChineseBRTUp(); }
-  else if (action == "chinese_brt_down") { currentPattern = 0; patternState = 0; ChineseBRTDown(); }
-  else if (action == "chinese_off") { currentPattern = 0; patternState = 0; ChineseOFF(); }
-  else if (action == "chinese_on") { currentPattern = 0; patternState = 0; ChineseON(); }
-  else if (action == "chinese_flash") { currentPattern = 0; patternState = 0; ChineseFLASH(); }
-  else if (action == "chinese_strobe") { currentPattern = 0; patternState = 0; ChineseSTROBE(); }
-  else if (action == "chinese_fade") { currentPattern = 0; patternState = 0; ChineseFADE(); }
-  else if (action == "chinese_smooth") { currentPattern = 0; patternState = 0; ChineseSMOOTH(); }
-  else if (action == "extra_red_blue") extra_red_blue();
-  else if (action == "extra_red_green") extra_red_green();
-  else if (action == "extra_red_white") extra_red_white();
-  else if (action == "extra_green_blue") extra_green_blue();
-  else if (action == "extra_green_white") extra_green_white();
-  else if (action == "extra_blue_white") extra_blue_white();
-  else {
-    request->send(400, "text/plain", "Invalid action");
-    return;
+  // Actions come from the remote profiles (see remotes.json)
+  int pattern = findPattern(action.c_str());
+  if (pattern >= 0) {
+    startPattern(pattern);
+  } else {
+    int command = findCommand(action.c_str());
+    if (command < 0) {
+      request->send(400, "text/plain", "Invalid action");
+      return;
+    }
+    currentPattern = 0;
+    patternState = 0;
+    sendCommand(command);
   }
   request->send(200, "text/plain", "OK");
 }
@@ -174,6 +149,7 @@ void handleSetSpeed(AsyncWebServerRequest *request) {
     unsigned long newDelay = speedStr.toInt();
     if (newDelay >= 100 && newDelay <= 5000) {
       color_pair_delay = newDelay;
+      wakeMainTask(); // re-time the running pattern
       Serial.printf("Speed set to %lums\n", color_pair_delay);
       request->send(200, "text/plain", "OK");
     } else {
@@ -184,6 +160,95 @@ void handleSetSpeed(AsyncWebServerRequest *request) {
   }
 }
 
+void handleRemotes(AsyncWebServerRequest *request) {
+  // Stream the reply so the table isn't held twice (document and String)
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  if (!serializeRemotes(*response)) {
+    delete response;
+    request->send(500, "text/plain", "Failed to serialize remotes");
+    return;
+  }
+  request->send(response);
+}
+
+void handleLearn(AsyncWebServerRequest *request) {
+  if (!irCaptureAvailable()) {
+    request->send(503, "text/plain", "No IR receiver");
+    return;
+  }
+  if (!request->hasParam("action")) {
+    request->send(400, "text/plain", "Missing 'action' parameter");
+    return;
+  }
+  String action = request->getParam("action")->value();
+  String label = request->hasParam("label") ? request->getParam("label")->value() : action;
+  if (!startLearning(action.c_str(), label.c_str())) {
+    request->send(400, "text/plain", "Action must be new and use only a-z, 0-9 and _");
+    return;
+  }
+  // A running pattern keeps the receiver busy with our own frames
+  currentPattern = 0;
+  patternState = 0;
+  wakeMainTask(); // start the learn timeout
+  request->send(200, "text/plain", "OK");
+}
+
+void handleLearnStatus(AsyncWebServerRequest *request) {
+  static const char* const states[] = { "idle", "waiting", "learned", "failed" };
+  DynamicJsonDocument doc(384);
+  doc["available"] = irCaptureAvailable();
+  doc["state"] = states[static_cast<uint8_t>(learnState())];
+  doc["action"] = learnAction();
+  const IrDecoder& decoder = irDecoder();
+  if (decoder.framesDecoded > 0) {
+    const IrDecodeResult& result = decoder.result();
+    doc["protocol"] = irProtocolName(result.protocol);
+    doc["code"] = result.code;
+    doc["address"] = result.address;
+    doc["bits"] = result.bits;
+  }
+  doc["framesDecoded"] = decoder.framesDecoded;
+  doc["framesRejected"] = decoder.framesRejected;
+  String jsonStr;
+  serializeJson(doc, jsonStr);
+  request->send(200, "application/json", jsonStr);
+}
+
+void handleSync(AsyncWebServerRequest *request) {
+  if (request->hasParam("role")) {
+    SyncRole role;
+    if (!parseSyncRole(request->getParam("role")->value().c_str(), role)) {
+      request->send(400, "text/plain", "Role must be off, leader or follower");
+      return;
+    }
+    if (!saveSyncRole(role)) {
+      request->send(500, "text/plain", "Failed to save sync role");
+      return;
+    }
+    // The Wi-Fi setup depends on the role, restart once the reply is out
+    Serial.printf("Sync role set to %s, restarting\n", syncRoleName(role));
+    request->onDisconnect([]() { ESP.restart(); });
+    request->send(200, "text/plain", "OK, restarting");
+    return;
+  }
+
+  SyncStatus sync = syncStatus();
+  DynamicJsonDocument doc(256);
+  doc["role"] = syncRoleName(sync.role);
+  doc["synced"] = sync.synced;
+  if (sync.role == SyncRole::Follower) {
+    doc["offsetUs"] = sync.offsetUs;
+    doc["driftPpm"] = sync.driftPpm;
+    doc["errorUs"] = sync.errorUs;
+    doc["delayUs"] = sync.delayUs;
+    doc["accepted"] = sync.accepted;
+    doc["rejected"] = sync.rejected;
+  }
+  String jsonStr;
+  serializeJson(doc, jsonStr);
+  request->send(200, "application/json", jsonStr);
+}
+
 void handleStyle(AsyncWebServerRequest *request) {
   if (!LittleFS.begin()) {
     request->send(500, "text/plain", "Filesystem error");
@@ -204,6 +269,16 @@ void handleScript(AsyncWebServerRequest *request) {
 // ElegantOTA Task (combines web server and OTA)
 // ============================================================================
 
+// Requests run in the AsyncTCP task, count each one as a wakeup like the
+// tasks that call recordWakeup() themselves
+static ArRequestHandlerFunction counted(ArRequestHandlerFunction handler) {
+  return [handler](AsyncWebServerRequest *request) {
+    uint32_t busyStart = micros();
+    handler(request);
+    recordWakeup(micros() - busyStart);
+  };
+}
+
 // ElegantOTA callbacks
 void onOTAStart() {
   Serial.println("OTA update started!");
@@ -225,6 +300,8 @@ void onOTAEnd(bool success) {
     Serial.println("OTA update failed!");
   }
   otaInProgress = false;
+  // ElegantOTA reboots from its loop(), wake the task to run it
+  xTaskNotifyGive(elegantOTATaskHandle);
 }
 void elegantOTATask(void *parameter) {
   Serial.println("ElegantOTA task started");
@@ -232,66 +309,87 @@ void elegantOTATask(void *parameter) {
   // Setup web server routes
 
   // Serve index.html (our control page) at root
-  server.on("/", HTTP_GET, handleRoot);
+  server.on("/", HTTP_GET, counted(handleRoot));
 
   // Serve our action handler
-  server.on("/action", HTTP_GET, handleAction);
+  server.on("/action", HTTP_GET, counted(handleAction));
 
   // Serve static files
-  server.on("/style.css", HTTP_GET, handleStyle);
-  server.on("/script.js", HTTP_GET, handleScript);
+  server.on("/style.css", HTTP_GET, counted(handleStyle));
+  server.on("/script.js", HTTP_GET, counted(handleScript));
 
   // Speed control
-  server.on("/set_speed", HTTP_GET, handleSetSpeed);
+  server.on("/set_speed", HTTP_GET, counted(handleSetSpeed));
+
+  // Remote profiles (the web UI builds its tabs from these)
+  server.on("/remotes", HTTP_GET, counted(handleRemotes));
+
+  // IR learn mode (needs a receiver, see IR_RECEIVER_PIN)
+  server.on("/learn", HTTP_GET, counted(handleLearn));
+  server.on("/learn_status", HTTP_GET, counted(handleLearnStatus));
+
+  // Clock sync role and status
+  server.on("/sync", HTTP_GET, counted(handleSync));
 
   // Captive portal redirects for various devices
-  server.on("/generate_204", HTTP_GET, [](AsyncWebServerRequest *request) {
+  server.on("/generate_204", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     // Android captive portal check - respond with 204 No Content
     request->send(204);
-  });
-  server.on("/gen_204", HTTP_GET, [](AsyncWebServerRequest *request) {
+  }));
+  server.on("/gen_204", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     // Alternative Android/Chrome captive portal check - respond with 204 No Content
     request->send(204);
-  });
-  server.on("/hotspot-detect.html", HTTP_GET, [](AsyncWebServerRequest *request) {
+  }));
+  server.on("/hotspot-detect.html", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     request->redirect("/");  // Apple captive portal check
-  });
-  server.on("/connectivity-check.html", HTTP_GET, [](AsyncWebServerRequest *request) {
+  }));
+  server.on("/connectivity-check.html", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     request->redirect("/");  // Windows/Linux captive portal check
-  });
-  server.on("/canonical.html", HTTP_GET, [](AsyncWebServerRequest *request) {
+  }));
+  server.on("/canonical.html", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     request->redirect("/");  // Firefox captive portal check
-  });
-  server.on("/ncsi.txt", HTTP_GET, [](AsyncWebServerRequest *request) {
+  }));
+  server.on("/ncsi.txt", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     // Chrome/Windows captive portal check - respond with success
     request->send(200, "text/plain", "success");
-  });
-  server.on("/connecttest.txt", HTTP_GET, [](AsyncWebServerRequest *request) {
+  }));
+  server.on("/connecttest.txt", HTTP_GET, counted([](AsyncWebServerRequest *request) {
     // Another common Chrome/Windows captive portal endpoint
     request->send(200, "text/plain", "success");
-  });
+  }));
 
   // System info endpoint (optional, for debugging)
-  server.on("/info", HTTP_GET, [](AsyncWebServerRequest *request) {
-    DynamicJsonDocument doc(256);
+  server.on("/info", HTTP_GET, counted([](AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(512);
     doc["freeHeap"] = ESP.getFreeHeap();
     doc["chipModel"] = ESP.getChipModel();
     doc["apIP"] = WiFi.softAPIP().toString();
     doc["connectedClients"] = WiFi.softAPgetStationNum();
     doc["otaInProgress"] = otaInProgress;
+    const PowerStats& power = powerStats();
+    doc["wakeupsPerSecond"] = power.wakeupsPerSecond;
+    doc["busyPercent"] = power.busyPercent;
+    doc["estimatedCurrentMa"] = power.estimatedCurrentMa;
+    doc["cpuMHz"] = power.cpuMhz;
+    doc["powerMode"] = power.mode;
+    doc["wakeupsCounted"] = "tasks, HTTP, DNS, sync (not the FreeRTOS tick or Wi-Fi)";
+    SyncStatus sync = syncStatus();
+    doc["syncRole"] = syncRoleName(sync.role);
+    doc["synced"] = sync.synced;
+    doc["syncErrorUs"] = sync.errorUs;
     String jsonStr;
     serializeJson(doc, jsonStr);
     request->send(200, "application/json", jsonStr);
-  });
+  }));
 
   // 404 handler - redirect to root for captive portal
-  server.onNotFound([](AsyncWebServerRequest *request) {
+  server.onNotFound(counted([](AsyncWebServerRequest *request) {
     if (captivePortalActive) {
       request->redirect("/");
     } else {
       request->send(404, "text/plain", "Not found");
     }
-  });
+  }));
 
   // Start ElegantOTA
   ElegantOTA.begin(&server);
@@ -302,12 +400,17 @@ void elegantOTATask(void *parameter) {
   server.begin();
   Serial.println("EasyOTA web server started");
 
-  // Main task loop
+  // Requests and DNS are handled by AsyncTCP / AsyncUDP callbacks, so this
+  // task sleeps until an OTA update ends and ElegantOTA needs its loop() to
+  // reboot (it waits 2s after the upload before restarting)
   for (;;) {
-    ElegantOTA.loop();
-    if (captivePortalActive) {
-      dnsServer.processNextRequest();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    unsigned long start = millis();
+    while (millis() - start < 5000) {
+      uint32_t busyStart = micros();
+      ElegantOTA.loop();
+      recordWakeup(micros() - busyStart);
+      vTaskDelay(pdMS_TO_TICKS(100));
     }
-    vTaskDelay(pdMS_TO_TICKS(10)); // 10ms delay
   }
 }
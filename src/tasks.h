@@ -5,13 +5,12 @@
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
 #include <ElegantOTA.h>
-#include <DNSServer.h>
 #include <ArduinoJson.h>
 #include <LittleFS.h>
+#include "remotes.h"
 
 // Global variables that need to be shared between files
 extern AsyncWebServer server;
-extern DNSServer dnsServer;
 extern bool otaInProgress;
 extern bool captivePortalActive;
 
@@ -27,6 +26,10 @@ extern unsigned long lastPatternTime;
 void handleRoot(AsyncWebServerRequest *request);
 void handleAction(AsyncWebServerRequest *request);
 void handleSetSpeed(AsyncWebServerRequest *request);
+void handleRemotes(AsyncWebServerRequest *request);
+void handleLearn(AsyncWebServerRequest *request);
+void handleLearnStatus(AsyncWebServerRequest *request);
+void handleSync(AsyncWebServerRequest *request);
 void handleStyle(AsyncWebServerRequest *request);
 void handleScript(AsyncWebServerRequest *request);
 String getContentType(String filename);
@@ -34,16 +37,10 @@ String getContentType(String filename);
 // EasyOTA task function
 void elegantOTATask(void *parameter);
 
-// Color and command functions (declared in main.cpp, but we need them for tasks.cpp)
-// These will be defined in main.cpp
-void Clear();
-void Red(); void Green(); void Blue(); void Yellow(); void Cyan(); void Magenta(); void White();
-void Off(); void Fade(); void Strobeplus(); void RGBStrobe(); void Rainbow();
-void Halfstrobe(); void BGStrobe(); void GRStrobe(); void Next(); void Demo(); void Previous();
-void ChineseRed(); void ChineseGreen(); void ChineseBlue(); void ChineseWhite();
-void ChineseBRTUp(); void ChineseBRTDown(); void ChineseOFF(); void ChineseON();
-void ChineseFLASH(); void ChineseSTROBE(); void ChineseFADE(); void ChineseSMOOTH();
-void extra_red_blue(); void extra_red_green(); void extra_red_white(); 
-void extra_green_blue(); void extra_green_white(); void extra_blue_white();
+// Pattern control (defined in main.cpp)
+void startPattern(uint8_t index);
+
+// Wakes the main loop early, e.g. when its next deadline changed
+void wakeMainTask();
 
 #endif // TASKS_H
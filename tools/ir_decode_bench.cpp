@@ -0,0 +1,206 @@
+// Replays raw IR captures through IrDecoder (src/ir_decoder.cpp) and reports
+// decode rate, accuracy and throughput.
+//
+// Capture files hold IRremote style raw arrays ("uint16_t rawData[67] =
+// {9000,4450, 600,550, ...};"), each preceded by the expected result:
+//
+//   expect NEC_MSB 0x00FF10EF
+//   expect SONY 0x15 address=0x1 bits=12
+//   expect NONE
+//
+// Lines starting with # are comments. See tools/ir_captures/.
+//
+//   g++ -std=c++11 -O2 -Isrc tools/ir_decode_bench.cpp src/ir_decoder.cpp -o ir_decode_bench
+//   ./ir_decode_bench tools/ir_captures/*.txt [-n iterations] [-v]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ir_decoder.h"
+
+struct Capture {
+  std::string file;
+  int line;
+  std::string note;
+  bool expectFrame;
+  IrProtocol protocol;
+  uint32_t code;
+  int address; // -1 = don't check
+  int bits;    // -1 = don't check
+  std::vector<uint16_t> timings;
+};
+
+static bool parseExpect(const std::string& text, Capture& capture) {
+  std::istringstream in(text);
+  std::string keyword, protocol;
+  in >> keyword >> protocol;
+  capture.expectFrame = protocol != "NONE";
+  capture.address = -1;
+  capture.bits = -1;
+  if (!capture.expectFrame) return true;
+  std::string code;
+  if (!parseIrProtocol(protocol.c_str(), capture.protocol) || !(in >> code)) return false;
+  capture.code = strtoul(code.c_str(), nullptr, 0);
+  std::string field;
+  while (in >> field) {
+    if (field.compare(0, 8, "address=") == 0) {
+      capture.address = strtoul(field.c_str() + 8, nullptr, 0);
+    } else if (field.compare(0, 5, "bits=") == 0) {
+      capture.bits = strtoul(field.c_str() + 5, nullptr, 0);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Numbers between { and }, the trailing // comment becomes the note
+static bool parseRaw(const std::string& text, Capture& capture) {
+  size_t open = text.find('{');
+  size_t close = text.find('}', open);
+  if (open == std::string::npos || close == std::string::npos) return false;
+  const char* p = text.c_str() + open + 1;
+  const char* end = text.c_str() + close;
+  while (p < end) {
+    char* next;
+    unsigned long value = strtoul(p, &next, 10);
+    if (next == p) {
+      p++;
+      continue;
+    }
+    capture.timings.push_back(value > 0xFFFF ? 0xFFFF : value);
+    p = next;
+  }
+  size_t comment = text.find("//", close);
+  if (comment != std::string::npos) {
+    capture.note = text.substr(text.find_first_not_of(" ", comment + 2));
+  }
+  return !capture.timings.empty();
+}
+
+static bool loadCaptures(const char* path, std::vector<Capture>& captures) {
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return false;
+  }
+  Capture pending;
+  bool havePending = false;
+  std::string text;
+  int line = 0;
+  while (std::getline(file, text)) {
+    line++;
+    size_t start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos || text[start] == '#') continue;
+    if (text.compare(start, 6, "expect") == 0) {
+      pending = Capture();
+      if (!parseExpect(text.substr(start), pending)) {
+        fprintf(stderr, "%s:%d: bad expect line\n", path, line);
+        return false;
+      }
+      havePending = true;
+    } else if (text.find('{') != std::string::npos) {
+      if (!havePending) {
+        fprintf(stderr, "%s:%d: capture without an expect line\n", path, line);
+        return false;
+      }
+      pending.file = path;
+      pending.line = line;
+      if (!parseRaw(text, pending)) {
+        fprintf(stderr, "%s:%d: bad raw array\n", path, line);
+        return false;
+      }
+      captures.push_back(pending);
+      havePending = false;
+    }
+  }
+  return true;
+}
+
+static bool matchesExpected(const Capture& capture, const IrDecodeResult& result) {
+  return result.protocol == capture.protocol && result.code == capture.code &&
+         (capture.address < 0 || result.address == capture.address) &&
+         (capture.bits < 0 || result.bits == capture.bits);
+}
+
+int main(int argc, char** argv) {
+  std::vector<Capture> captures;
+  int iterations = 2000;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (!loadCaptures(argv[i], captures)) {
+      return 2;
+    }
+  }
+  if (captures.empty()) {
+    fprintf(stderr, "usage: %s captures.txt... [-n iterations] [-v]\n", argv[0]);
+    return 2;
+  }
+
+  // Accuracy: a fresh decoder per capture, like a button press after a pause
+  uint32_t frames = 0, decoded = 0, correct = 0, rejects = 0, falseDecodes = 0;
+  uint64_t edges = 0;
+  for (const Capture& capture : captures) {
+    IrDecoder decoder;
+    uint16_t count = decoder.feedRaw(capture.timings.data(), capture.timings.size());
+    edges += capture.timings.size();
+    const IrDecodeResult& result = decoder.result();
+    bool ok;
+    if (capture.expectFrame) {
+      frames++;
+      if (count > 0) decoded++;
+      // Exactly one frame: a false decode next to the good one is a failure
+      // too, and result() would only show the last of them
+      ok = count == 1 && matchesExpected(capture, result);
+      if (ok) correct++;
+    } else {
+      rejects++;
+      ok = count == 0;
+      if (!ok) falseDecodes++;
+    }
+    if (!ok || verbose) {
+      printf("%s %s:%d (%s): ", ok ? "ok  " : "FAIL", capture.file.c_str(), capture.line,
+             capture.note.c_str());
+      if (count > 1) printf("%u frames, last ", count);
+      if (count > 0) {
+        printf("%s 0x%lX address 0x%X, %u bits\n", irProtocolName(result.protocol),
+               (unsigned long)result.code, result.address, result.bits);
+      } else {
+        printf("no frame\n");
+      }
+    }
+  }
+
+  // Throughput: the whole corpus replayed through one decoder
+  IrDecoder decoder;
+  uint64_t replayed = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    for (const Capture& capture : captures) {
+      replayed += decoder.feedRaw(capture.timings.data(), capture.timings.size());
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%zu captures, %lu edges\n", captures.size(), (unsigned long)edges);
+  printf("Decode rate: %lu/%lu frames (%.1f%%)\n", (unsigned long)decoded, (unsigned long)frames,
+         frames ? 100.0 * decoded / frames : 0);
+  printf("Accuracy: %lu/%lu correct (%.1f%%), %lu/%lu rejects decoded by mistake\n",
+         (unsigned long)correct, (unsigned long)frames, frames ? 100.0 * correct / frames : 0,
+         (unsigned long)falseDecodes, (unsigned long)rejects);
+  if (iterations > 0 && seconds > 0) {
+    printf("Throughput: %.0f frames/s, %.1f M edges/s (%d replays, %lu frames)\n",
+           replayed / seconds, edges * iterations / seconds / 1e6, iterations,
+           (unsigned long)replayed);
+  }
+  return (correct == frames && falseDecodes == 0) ? 0 : 1;
+}
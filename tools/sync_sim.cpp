@@ -0,0 +1,239 @@
+// Loopback simulation of the clock sync protocol in src/clock_sync.cpp.
+//
+// One leader and several followers exchange encoded messages over a fake
+// network with base latency, random jitter, occasional queueing spikes and
+// loss. Each follower's crystal runs fast or slow by up to 100ppm and boots
+// at a random offset. After the warm up, the follower's idea of leader time
+// is compared with the real leader clock, which is the phase error its
+// pattern scheduler would see.
+//
+// A third of the way in the leader restarts (same id, clock back near zero),
+// and two thirds in it is replaced by a unit with a new id and clock. Each
+// follower has to drop the old state and sync again within a bounded time;
+// probes while it does are left out of the phase error.
+//
+//   g++ -std=c++11 -O2 -Isrc tools/sync_sim.cpp src/clock_sync.cpp -o sync_sim
+//   ./sync_sim [minutes] [latency_us] [jitter_us] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <vector>
+#include "clock_sync.h"
+
+const int kFollowers = 3;
+const uint64_t kWarmupUs = 10000000;
+const uint64_t kAcquireIntervalUs = 250000; // same as sync_udp.cpp
+const uint64_t kRequestIntervalUs = 1000000;
+const uint64_t kAnnounceIntervalUs = 1000000;
+const uint64_t kProbeIntervalUs = 10000;
+const double kSpikeChance = 0.05;
+const double kLossChance = 0.02;
+
+// Restart: the next announce (1s) gives it away. Swap: the old leader is
+// followed until kSyncTimeoutUs without an exchange.
+const uint64_t kRestartResyncUs = 5000000;
+const uint64_t kSwapResyncUs = kSyncTimeoutUs + 5000000;
+const double kMaxErrorUs = 3000;
+
+struct Packet {
+  uint64_t arrivalUs; // true time
+  int to;             // -1 = leader
+  uint8_t data[kSyncMessageSize];
+  bool operator>(const Packet& other) const { return arrivalUs > other.arrivalUs; }
+};
+
+struct Clock {
+  double offsetUs;
+  double driftPpm;
+  uint64_t read(uint64_t trueUs) const {
+    return (uint64_t)llround(trueUs + offsetUs + trueUs * driftPpm * 1e-6);
+  }
+};
+
+int main(int argc, char** argv) {
+  double minutes = argc > 1 ? atof(argv[1]) : 10;
+  double latencyUs = argc > 2 ? atof(argv[2]) : 2000;
+  double jitterUs = argc > 3 ? atof(argv[3]) : 1500;
+  unsigned seed = argc > 4 ? atoi(argv[4]) : 1;
+
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::exponential_distribution<double> jitter(1.0 / jitterUs);
+  auto transit = [&]() {
+    double us = latencyUs + jitter(rng);
+    if (unit(rng) < kSpikeChance) us += 20000 + 60000 * unit(rng); // Wi-Fi retries, power save
+    return (uint64_t)us;
+  };
+
+  Clock leaderClock = { 5e9, 0 };
+  uint32_t leaderId = 1;
+  Clock clocks[kFollowers];
+  SyncFollower followers[kFollowers];
+  uint64_t nextRequest[kFollowers];
+  for (int i = 0; i < kFollowers; i++) {
+    clocks[i].offsetUs = 1e9 * unit(rng);
+    clocks[i].driftPpm = 200 * unit(rng) - 100;
+    followers[i] = SyncFollower(0x100 + i);
+    nextRequest[i] = (uint64_t)(1e6 * unit(rng));
+  }
+
+  std::priority_queue<Packet, std::vector<Packet>, std::greater<Packet> > network;
+  auto send = [&](const SyncMessage& message, int to, uint64_t nowUs) {
+    if (unit(rng) < kLossChance) return;
+    Packet packet;
+    packet.arrivalUs = nowUs + transit();
+    packet.to = to;
+    encodeSyncMessage(message, packet.data, sizeof(packet.data));
+    network.push(packet);
+  };
+
+  const uint64_t endUs = (uint64_t)(minutes * 60e6);
+  uint64_t nextAnnounce = 0;
+  uint64_t nextProbe = kWarmupUs;
+  uint16_t announceSequence = 0;
+  std::vector<double> errors;
+  double worst = 0;
+  uint64_t unsyncedProbes = 0;
+
+  // Leader restart and swap, then how long each follower took to sync again
+  const char* const eventNames[2] = { "leader restart", "leader swap" };
+  const uint64_t eventLimitUs[2] = { kRestartResyncUs, kSwapResyncUs };
+  uint64_t eventUs[2] = { endUs / 3, endUs * 2 / 3 };
+  int nextEvent = 0;
+  int currentEvent = -1;
+  bool recovering[kFollowers] = {};
+  bool wasReset[kFollowers] = {};
+  uint32_t lastAccepted[kFollowers] = {};
+  uint64_t resyncUs[2][kFollowers] = {};
+  bool failed = false;
+
+  for (uint64_t now = 0; now < endUs; ) {
+    // Next event in true time
+    uint64_t next = std::min(nextAnnounce, nextProbe);
+    if (nextEvent < 2) next = std::min(next, eventUs[nextEvent]);
+    for (int i = 0; i < kFollowers; i++) next = std::min(next, nextRequest[i]);
+    if (!network.empty()) next = std::min(next, network.top().arrivalUs);
+    now = next;
+
+    if (!network.empty() && network.top().arrivalUs == now) {
+      Packet packet = network.top();
+      network.pop();
+      SyncMessage message;
+      if (!decodeSyncMessage(packet.data, sizeof(packet.data), message)) continue;
+      if (packet.to < 0) {
+        // Leader answers requests meant for it after a little processing time
+        if (message.targetId != leaderId) continue;
+        uint64_t rx = leaderClock.read(now);
+        uint64_t tx = leaderClock.read(now + 200 + (uint64_t)(300 * unit(rng)));
+        send(makeDelayResponse(message, leaderId, rx, tx), message.senderId - 0x100, now + 200);
+      } else if (message.type == SyncMessageType::Announce) {
+        followers[packet.to].onAnnounce(message, clocks[packet.to].read(now));
+      } else {
+        followers[packet.to].onDelayResponse(message, clocks[packet.to].read(now));
+      }
+      continue;
+    }
+
+    if (nextEvent < 2 && now == eventUs[nextEvent]) {
+      if (nextEvent == 0) {
+        leaderClock.offsetUs = 3e6 - now; // booted 3s ago
+      } else {
+        leaderId = 2;
+        leaderClock.offsetUs = 2e9 * unit(rng);
+        leaderClock.driftPpm = 40;
+      }
+      announceSequence = 0;
+      currentEvent = nextEvent++;
+      for (int i = 0; i < kFollowers; i++) {
+        recovering[i] = true;
+        wasReset[i] = false;
+        lastAccepted[i] = followers[i].accepted;
+      }
+      continue;
+    }
+
+    if (now == nextAnnounce) {
+      SyncMessage announce = makeAnnounce(leaderId, ++announceSequence, leaderClock.read(now), 500);
+      for (int i = 0; i < kFollowers; i++) send(announce, i, now);
+      nextAnnounce += kAnnounceIntervalUs;
+      continue;
+    }
+
+    for (int i = 0; i < kFollowers; i++) {
+      if (now != nextRequest[i]) continue;
+      uint64_t local = clocks[i].read(now);
+      if (followers[i].hasLeader()) send(followers[i].makeDelayRequest(local), -1, now);
+      nextRequest[i] += followers[i].synced(local) ? kRequestIntervalUs : kAcquireIntervalUs;
+    }
+
+    if (now == nextProbe) {
+      for (int i = 0; i < kFollowers; i++) {
+        uint64_t local = clocks[i].read(now);
+        if (recovering[i]) {
+          // The old fit stays in use until the follower notices and resets
+          const SyncFollower& f = followers[i];
+          if (f.accepted < lastAccepted[i]) wasReset[i] = true;
+          lastAccepted[i] = f.accepted;
+          uint64_t elapsed = now - eventUs[currentEvent];
+          if (wasReset[i] && f.leaderId == leaderId && f.synced(local)) {
+            recovering[i] = false;
+            resyncUs[currentEvent][i] = elapsed;
+          } else if (elapsed > eventLimitUs[currentEvent]) {
+            printf("Follower %d not synced %.1fs after the %s\n", i, elapsed / 1e6,
+                   eventNames[currentEvent]);
+            recovering[i] = false;
+            resyncUs[currentEvent][i] = UINT64_MAX;
+            failed = true;
+          } else {
+            continue;
+          }
+        }
+        if (!followers[i].synced(local)) {
+          unsyncedProbes++;
+          continue;
+        }
+        double error = (double)(int64_t)(followers[i].toLeader(local) - leaderClock.read(now));
+        errors.push_back(fabs(error));
+        worst = std::max(worst, fabs(error));
+      }
+      nextProbe += kProbeIntervalUs;
+    }
+  }
+
+  printf("Simulated %.1f min, %d followers, latency %.0fus + exp(%.0fus), %.0f%% spikes, %.0f%% loss\n",
+         minutes, kFollowers, latencyUs, jitterUs, kSpikeChance * 100, kLossChance * 100);
+  for (int i = 0; i < kFollowers; i++) {
+    const SyncFollower& f = followers[i];
+    // Drift against the leader at the end of the run
+    printf("  follower %d: true drift %+7.1fppm, estimated %+7.1fppm, fit rms %6.0fus, accepted %lu, rejected %lu\n",
+           i, clocks[i].driftPpm - leaderClock.driftPpm, -f.driftPpm(), f.errorUs(),
+           (unsigned long)f.accepted, (unsigned long)f.rejected);
+  }
+  if (errors.empty()) {
+    printf("No synced probes\n");
+    return 1;
+  }
+  std::sort(errors.begin(), errors.end());
+  double sumSquares = 0;
+  for (double e : errors) sumSquares += e * e;
+  printf("Phase error after %.0fs warm up: rms %.0fus, p99 %.0fus, max %.0fus (%lu unsynced probes)\n",
+         kWarmupUs / 1e6, sqrt(sumSquares / errors.size()),
+         errors[errors.size() * 99 / 100], worst, (unsigned long)unsyncedProbes);
+  for (int e = 0; e < nextEvent; e++) {
+    printf("Synced again after the %s at %.0fs:", eventNames[e], eventUs[e] / 1e6);
+    for (int i = 0; i < kFollowers; i++) {
+      if (resyncUs[e][i] == UINT64_MAX) printf(" never");
+      else printf(" %.1fs", resyncUs[e][i] / 1e6);
+    }
+    printf(" (limit %.0fs)\n", eventLimitUs[e] / 1e6);
+  }
+  if (nextEvent < 2 || currentEvent < 0) {
+    printf("Run too short for the leader restart and swap\n");
+    failed = true;
+  }
+  return !failed && worst < kMaxErrorUs ? 0 : 1;
+}